@@ -1,25 +1,38 @@
 #include <avr/io.h>
 #include <util/delay.h>
+#include <avr/interrupt.h>
 #include "adc.h"
+#include "board.h"
+
+volatile uint16_t adc_value;
+volatile unsigned char adc_ready;
+
+// ADC clock 50..200kHz
+#if F_CPU <= 1000000UL
+#define ADC_PRESCALER ((1<<ADPS1)|(1<<ADPS0))                   // /8
+#elif F_CPU <= 8000000UL
+#define ADC_PRESCALER ((1<<ADPS2)|(1<<ADPS1))                   // /64
+#else
+#define ADC_PRESCALER ((1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0))        // /128
+#endif
 
 // initialize adc
 void adc_init(){
-    // AREF = AVcc
-    ADMUX = (1<<REFS0);
+    // reference VCC/AVcc, REFS bits differ per MCU
+    ADMUX = ADC_REF;
  
-    // ADC Enable and prescaler of 128
+    // ADC Enable and prescaler
     // 16000000/128 = 125000
-    ADCSRA = (1<<ADEN)|(1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0);
+    ADCSRA = (1<<ADEN)|ADC_PRESCALER;
 }
  
 // read adc value
 uint16_t adc_read(uint8_t ch)
 {
-    // select the corresponding channel 0~7
-    // ANDing with '7' will always keep the value
-    // of 'ch' between 0 and 7
-    ch &= 0b00000111;  // AND operation with 7
-    ADMUX = (ADMUX & 0xF8)|ch;     // clears the bottom 3 bits before ORing
+    // select the corresponding channel, the MUX field is
+    // 4 bits (ATtiny85, ATmega328P) or 6 bits (ATtiny84) wide
+    ch &= ADC_MUX_MASK;
+    ADMUX = (ADMUX & ~ADC_MUX_MASK)|ch;     // clears the MUX bits before ORing
  
     // start single conversion
     // write '1' to ADSC
@@ -32,3 +45,21 @@ uint16_t adc_read(uint8_t ch)
  
     return (ADC);
 }
+
+// start a conversion without waiting for it,
+// ADC_vect stores the result in adc_value and sets adc_ready
+// admux : reference and channel, e.g. ADC_PRESSURE or ADC_TEMP from board.h
+void adc_start(uint8_t admux)
+{
+    ADMUX = admux;
+
+    adc_ready = 0;
+    ADCSRA |= (1<<ADIE)|(1<<ADSC);
+}
+
+ISR(ADC_vect)
+{
+    ADCSRA &= ~(1<<ADIE);           // one shot, adc_read() keeps polling
+    adc_value = ADC;
+    adc_ready = 1;
+}
@@ -1,2 +1,6 @@
 void adc_init();
 uint16_t adc_read(uint8_t ch);
+void adc_start(uint8_t admux);
+
+extern volatile uint16_t adc_value;     // result of the last adc_start()
+extern volatile unsigned char adc_ready;    // adc_value holds a new result
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <avr/io.h>
+
+/* ---------------------------------------------------------------------------
+ *
+ * per MCU pin map, timers and register names, picked at compile time from
+ * -mmcu, see the Makefile targets
+ *
+ *  ATtiny84    sonar   INT0 (PB2), edges time-stamped on 16-bit Timer1
+ *                      (ICP1 is PA7, taken by LCD D7)
+ *              tick    Timer0 CTC
+ *              LCD     parallel on PORTA, busy flag on PA7, no pin left
+ *                      for LCD power (display off only), the button
+ *                      shares D4
+ *
+ *  ATtiny85    sonar   INT0 (PB2), trigger and echo on the same pin
+ *                      (echo joined to trigger through 1k), 8-bit Timer0
+ *                      with overflow count, there is no 16-bit timer
+ *              tick    Timer1 CTC (OCR1C)
+ *              LCD     74HC595 shift register, no RW (timed writes),
+ *                      LED and LCD power on spare 595 outputs
+ *                      (power off cuts the controller too)
+ *
+ *  ATmega328P  sonar   ICP1 (PB0) on 16-bit Timer1, edges captured in hardware
+ *              tick    Timer0 CTC
+ *              LCD     parallel, data on PORTD, control on PORTC,
+ *                      backlight switched on PB2
+ *
+ * ---------------------------------------------------------------------------*/
+
+// timer prescalers for the clock we run at
+#if F_CPU <= 1000000UL
+#define SONAR_PRESCALE      1
+#define TICK_PRESCALE       8
+#elif F_CPU <= 8000000UL
+#define SONAR_PRESCALE      8
+#define TICK_PRESCALE       64
+#else
+#define SONAR_PRESCALE      64
+#define TICK_PRESCALE       64
+#endif
+
+#define SONAR_TICKS_PER_MS  (F_CPU / SONAR_PRESCALE / 1000)
+#define TICK_OCR            (F_CPU / TICK_PRESCALE / 1000 - 1)
+#define TICK_REM            ((F_CPU / TICK_PRESCALE) % 1000)    // timer counts per s left over, 500 @ 4MHz
+
+#if SONAR_PRESCALE == 1
+#define SONAR_CS            (1 << CS10)
+#elif SONAR_PRESCALE == 8
+#define SONAR_CS            (1 << CS11)
+#else
+#define SONAR_CS            ((1 << CS11) | (1 << CS10))
+#endif
+
+
+/*============================== ATtiny84 ==================================*/
+#if defined(__AVR_ATtiny84__) || defined(__AVR_ATtiny84A__)
+
+// LED
+#define LED_DDRB_OUTPUT_MODE()  DDRB |= (1<<PB0)
+#define LED_HIGH()              PORTB |= (1<<PB0)
+#define LED_LOW()               PORTB &= ~(1<<PB0)
+
+// sonar : INT0 + Timer1 time stamps
+#define SONAR_T16
+#define SONAR_TRIGGER_DDR       DDRB
+#define SONAR_TRIGGER_PORT      PORTB
+#define SONAR_TRIGGER_PIN       PB1         // PB1 pin 3
+#define SONAR_ECHO_DDR          DDRB
+#define SONAR_ECHO_PORT         PORTB
+#define SONAR_ECHO_IN           PINB
+#define SONAR_ECHO_PIN          PB2         // PB2 pin 5, INT0
+#define SONAR_INT0_INIT()       do { MCUCR |= (1 << ISC00); GIMSK |= (1 << INT0); } while (0)
+#define SONAR_TIMEOUT_vect      TIM1_COMPB_vect
+
+// tick : Timer0 CTC
+#define TICK_vect               TIM0_COMPA_vect
+#define TICK_INIT()             do { OCR0A = TICK_OCR; TCCR0A = (1 << WGM01); TCCR0B = TICK_CS; TIMSK0 |= (1 << OCIE0A); } while (0)
+#define TICK_TOP(top)           OCR0A = (top)
+#if TICK_PRESCALE == 8
+#define TICK_CS                 (1 << CS01)
+#else
+#define TICK_CS                 ((1 << CS01) | (1 << CS00))
+#endif
+
+// button : PA4 pin 9 to GND through 10k, shared with LCD D4, which
+// idles as input with pull-up between writes (lcd_D4_shared), PCINT4
+#define BUTTON_DDR              DDRA
+#define BUTTON_PORT             PORTA
+#define BUTTON_IN               PINA
+#define BUTTON_PIN              PA4
+#define BUTTON_PCINT_INIT()     do { PCMSK0 |= (1 << PCINT4); GIMSK |= (1 << PCIE0); } while (0)
+#define BUTTON_vect             PCINT0_vect
+
+// ADC : VCC reference, 6 bit MUX, values are complete ADMUX settings
+#define ADC_REF                 0
+#define ADC_MUX_MASK            0x3F
+#define ADC_PRESSURE            (ADC_REF | 0)           // PA0
+#define ADC_TEMP                ((1 << REFS1) | 0x22)   // internal sensor, 1.1V reference
+#define ADC_TEMP_OFFSET         275                     // LSB at 0 degC, ~1 LSB/degC
+#define ADC_BANDGAP             (ADC_REF | 0x21)        // 1.1V bandgap against VCC
+
+// watchdog
+#define WDT_CONTROL             WDTCSR
+
+// LCD
+#define lcd_D7_port     PORTA                   // lcd D7 connection
+#define lcd_D7_bit      PORTA7
+#define lcd_D7_ddr      DDRA
+#define lcd_D7_pin      PINA                    // busy flag
+
+#define lcd_D6_port     PORTA                   // lcd D6 connection
+#define lcd_D6_bit      PORTA6
+#define lcd_D6_ddr      DDRA
+
+#define lcd_D5_port     PORTA                   // lcd D5 connection
+#define lcd_D5_bit      PORTA5
+#define lcd_D5_ddr      DDRA
+
+#define lcd_D4_port     PORTA                   // lcd D4 connection
+#define lcd_D4_bit      PORTA4
+#define lcd_D4_ddr      DDRA
+#define lcd_D4_shared                           // also the button, see lcd_write
+
+#define lcd_E_port      PORTA                   // lcd Enable pin
+#define lcd_E_bit       PORTA1
+#define lcd_E_ddr       DDRA
+
+#define lcd_RS_port     PORTA                   // lcd Register Select pin
+#define lcd_RS_bit      PORTA3
+#define lcd_RS_ddr      DDRA
+
+#define lcd_RW_port     PORTA                   // lcd Read/Write pin
+#define lcd_RW_bit      PORTA2
+#define lcd_RW_ddr      DDRA
+
+
+/*============================== ATtiny85 ==================================*/
+#elif defined(__AVR_ATtiny85__)
+
+// LED on the shift register
+#define LED_DDRB_OUTPUT_MODE()
+#define LED_HIGH()              lcd_sr_aux(lcd_SR_LED, 1)
+#define LED_LOW()               lcd_sr_aux(lcd_SR_LED, 0)
+
+// sonar : INT0 + Timer0 overflow count, one pin
+#define SONAR_T8
+#define SONAR_ONE_PIN
+#define SONAR_TRIGGER_DDR       DDRB
+#define SONAR_TRIGGER_PORT      PORTB
+#define SONAR_TRIGGER_PIN       PB2         // pin 7, also the echo
+#define SONAR_ECHO_DDR          DDRB
+#define SONAR_ECHO_PORT         PORTB
+#define SONAR_ECHO_IN           PINB
+#define SONAR_ECHO_PIN          PB2         // INT0
+#define SONAR_INT0_INIT()       do { MCUCR |= (1 << ISC00); GIMSK |= (1 << INT0); } while (0)
+#define SONAR_INT0_OFF()        GIMSK &= ~(1 << INT0)
+#define SONAR_INT0_ON()         do { GIFR = (1 << INTF0); GIMSK |= (1 << INT0); } while (0)
+#define SONAR_OVF_vect          TIMER0_OVF_vect
+#if SONAR_PRESCALE == 1
+#define SONAR_CS0               (1 << CS00)
+#else
+#define SONAR_CS0               (1 << CS01)
+#endif
+
+// tick : Timer1 CTC, top in OCR1C, interrupt from OCR1A
+#define TICK_vect               TIMER1_COMPA_vect
+#define TICK_INIT()             do { OCR1C = TICK_OCR; OCR1A = TICK_OCR; TCCR1 = (1 << CTC1) | TICK_CS; TIMSK |= (1 << OCIE1A); } while (0)
+#define TICK_TOP(top)           do { OCR1C = (top); OCR1A = (top); } while (0)
+#if TICK_PRESCALE == 8
+#define TICK_CS                 (1 << CS12)
+#else
+#define TICK_CS                 ((1 << CS12) | (1 << CS11) | (1 << CS10))
+#endif
+
+// button : PB0 pin 5 to GND through 10k, shared with the 595 SER line,
+// idles as input with pull-up (see lcd_sr_flush), PCINT0
+#define BUTTON_DDR              DDRB
+#define BUTTON_PORT             PORTB
+#define BUTTON_IN               PINB
+#define BUTTON_PIN              PB0
+#define BUTTON_PCINT_INIT()     do { PCMSK |= (1 << PCINT0); GIMSK |= (1 << PCIE); } while (0)
+#define BUTTON_vect             PCINT0_vect
+
+// ADC : VCC reference, 4 bit MUX, values are complete ADMUX settings
+#define ADC_REF                 0
+#define ADC_MUX_MASK            0x0F
+#define ADC_PRESSURE            (ADC_REF | 2)           // PB4 pin 3
+#define ADC_TEMP                ((1 << REFS1) | 0x0F)   // internal sensor, 1.1V reference
+#define ADC_TEMP_OFFSET         275                     // LSB at 0 degC, ~1 LSB/degC
+#define ADC_BANDGAP             (ADC_REF | 0x0C)        // 1.1V bandgap against VCC
+
+// watchdog
+#define WDT_CONTROL             WDTCR
+
+// LCD on a 74HC595, RW tied to GND
+//      PB0 SER (idles as input, see lcd_sr_flush), PB1 SRCLK, PB3 RCLK
+//      Q0..Q3 D4..D7, Q4 RS, Q5 E, Q6 LED, Q7 LCD power
+#define lcd_SR
+#define lcd_NoRW
+#define lcd_SR_port     PORTB
+#define lcd_SR_ddr      DDRB
+#define lcd_SR_data     PB0
+#define lcd_SR_clock    PB1
+#define lcd_SR_latch    PB3
+#define lcd_SR_LED      6
+#define lcd_SR_Power    7
+
+#define lcd_D7_port     lcd_sr                  // bits of the shift register image
+#define lcd_D7_bit      3
+#define lcd_D6_port     lcd_sr
+#define lcd_D6_bit      2
+#define lcd_D5_port     lcd_sr
+#define lcd_D5_bit      1
+#define lcd_D4_port     lcd_sr
+#define lcd_D4_bit      0
+#define lcd_RS_port     lcd_sr
+#define lcd_RS_bit      4
+#define lcd_E_port      lcd_sr
+#define lcd_E_bit       5
+
+
+/*============================== ATmega328P ================================*/
+#elif defined(__AVR_ATmega328P__)
+
+// LED
+#define LED_DDRB_OUTPUT_MODE()  DDRB |= (1<<PB5)
+#define LED_HIGH()              PORTB |= (1<<PB5)
+#define LED_LOW()               PORTB &= ~(1<<PB5)
+
+// sonar : input capture on Timer1
+#define SONAR_ICP
+#define SONAR_TRIGGER_DDR       DDRB
+#define SONAR_TRIGGER_PORT      PORTB
+#define SONAR_TRIGGER_PIN       PB1
+#define SONAR_ECHO_DDR          DDRB
+#define SONAR_ECHO_PORT         PORTB
+#define SONAR_ECHO_IN           PINB
+#define SONAR_ECHO_PIN          PB0         // ICP1
+#define SONAR_TIMEOUT_vect      TIMER1_COMPB_vect
+
+// tick : Timer0 CTC
+#define TICK_vect               TIMER0_COMPA_vect
+#define TICK_INIT()             do { OCR0A = TICK_OCR; TCCR0A = (1 << WGM01); TCCR0B = TICK_CS; TIMSK0 |= (1 << OCIE0A); } while (0)
+#define TICK_TOP(top)           OCR0A = (top)
+#if TICK_PRESCALE == 8
+#define TICK_CS                 (1 << CS01)
+#else
+#define TICK_CS                 ((1 << CS01) | (1 << CS00))
+#endif
+
+// button : PD2, PCINT18
+#define BUTTON_DDR              DDRD
+#define BUTTON_PORT             PORTD
+#define BUTTON_IN               PIND
+#define BUTTON_PIN              PD2
+#define BUTTON_PCINT_INIT()     do { PCMSK2 |= (1 << PCINT18); PCICR |= (1 << PCIE2); } while (0)
+#define BUTTON_vect             PCINT2_vect
+
+// ADC : AVCC reference, 4 bit MUX, values are complete ADMUX settings
+#define ADC_REF                 (1 << REFS0)
+#define ADC_MUX_MASK            0x0F
+#define ADC_PRESSURE            (ADC_REF | 0)                       // PC0
+#define ADC_TEMP                ((1 << REFS1) | (1 << REFS0) | 0x08) // internal sensor, 1.1V reference
+#define ADC_TEMP_OFFSET         289                                 // LSB at 0 degC, ~1 LSB/degC
+#define ADC_BANDGAP             (ADC_REF | 0x0E)                    // 1.1V bandgap against AVCC
+
+// watchdog
+#define WDT_CONTROL             WDTCSR
+
+// LCD
+#define lcd_D7_port     PORTD                   // lcd D7 connection
+#define lcd_D7_bit      PORTD7
+#define lcd_D7_ddr      DDRD
+#define lcd_D7_pin      PIND                    // busy flag
+
+#define lcd_D6_port     PORTD                   // lcd D6 connection
+#define lcd_D6_bit      PORTD6
+#define lcd_D6_ddr      DDRD
+
+#define lcd_D5_port     PORTD                   // lcd D5 connection
+#define lcd_D5_bit      PORTD5
+#define lcd_D5_ddr      DDRD
+
+#define lcd_D4_port     PORTD                   // lcd D4 connection
+#define lcd_D4_bit      PORTD4
+#define lcd_D4_ddr      DDRD
+
+#define lcd_E_port      PORTC                   // lcd Enable pin
+#define lcd_E_bit       PORTC3
+#define lcd_E_ddr       DDRC
+
+#define lcd_RS_port     PORTC                   // lcd Register Select pin
+#define lcd_RS_bit      PORTC1
+#define lcd_RS_ddr      DDRC
+
+#define lcd_RW_port     PORTC                   // lcd Read/Write pin
+#define lcd_RW_bit      PORTC2
+#define lcd_RW_ddr      DDRC
+
+#define lcd_BL_port     PORTB                   // backlight switch, the controller stays powered
+#define lcd_BL_bit      PORTB2
+#define lcd_BL_ddr      DDRB
+
+#else
+#error "no pin map for this MCU, see board.h"
+#endif
@@ -0,0 +1,54 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "button.h"
+#include "board.h"
+
+/* ---------------------------------------------------------------------------
+ *
+ * The pin change interrupt only wakes the CPU, the main loop debounces by
+ * polling the pin against the ms tick. The button pulls the pin to GND.
+ *
+ * ---------------------------------------------------------------------------*/
+
+static uint8_t raw;                     // pin state at the last poll, 1 = pressed
+static uint8_t pressed;                 // debounced state
+static uint8_t held;                    // BUTTON_LONG already reported for this press
+static uint32_t rawSince;               // ms, raw last changed
+static uint32_t pressedAt;              // ms, debounced press
+
+void button_init(void){
+    BUTTON_DDR &= ~(1 << BUTTON_PIN);   // input
+    BUTTON_PORT |= (1 << BUTTON_PIN);   // pull-up
+    BUTTON_PCINT_INIT();
+}
+
+// raw pin, no debouncing, for when the tick is stopped
+uint8_t button_down(void){
+    return !(BUTTON_IN & (1 << BUTTON_PIN));
+}
+
+uint8_t button_poll(uint32_t now){
+    uint8_t down = button_down();
+
+    if (down != raw){
+        raw = down;
+        rawSince = now;
+    }
+    if (raw != pressed && now - rawSince >= BUTTON_DEBOUNCE){
+        pressed = raw;
+        if (pressed){
+            pressedAt = now;
+            held = 0;
+        }else if (!held){
+            return BUTTON_SHORT;
+        }
+    }
+    if (pressed && !held && now - pressedAt >= BUTTON_HOLD){
+        held = 1;
+        return BUTTON_LONG;
+    }
+    return BUTTON_NONE;
+}
+
+EMPTY_INTERRUPT(BUTTON_vect);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+/* ---------------------------------------------------------------------------
+ * one push button on a pin change interrupt, pin per MCU in board.h
+ * ---------------------------------------------------------------------------*/
+
+#define BUTTON_DEBOUNCE     30          // ms the pin must be stable
+#define BUTTON_HOLD         1000        // ms for a long press
+
+// button_poll results
+#define BUTTON_NONE         0
+#define BUTTON_SHORT        1           // released before BUTTON_HOLD
+#define BUTTON_LONG         2           // held BUTTON_HOLD, reported while still down
+
+void button_init(void);
+uint8_t button_poll(uint32_t now);
+uint8_t button_down(void);
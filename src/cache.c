@@ -0,0 +1,51 @@
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "cache.h"
+
+/* ---------------------------------------------------------------------------
+ *
+ * EEPROM cells survive ~100.000 writes. A write only happens when the level
+ * moved CACHE_MIN_DELTA liters and CACHE_MIN_PERIOD seconds passed since the
+ * previous one. The delta is more than the 1 cm resolution of the sensor,
+ * a reading flickering between two cm never writes; normal burner
+ * consumption gives about one write a day.
+ * eeprom_update_* skips bytes that did not change.
+ *
+ * stamp : seconds, as passed in by the caller
+ *
+ * ---------------------------------------------------------------------------*/
+
+static uint16_t EEMEM ee_liters = CACHE_EMPTY;
+static uint32_t EEMEM ee_stamp;
+static uint16_t EEMEM ee_bootTime;     // ms from reset to the first live reading, last boot
+
+static uint16_t savedLiters = CACHE_EMPTY;
+static uint32_t savedStamp;
+
+// returns 0 when nothing was cached yet
+uint8_t cache_load(uint16_t *liters, uint32_t *stamp){
+    savedLiters = eeprom_read_word(&ee_liters);
+    savedStamp = eeprom_read_dword(&ee_stamp);
+    *liters = savedLiters;
+    *stamp = savedStamp;
+    return savedLiters != CACHE_EMPTY;
+}
+
+void cache_save(uint16_t liters, uint32_t stamp){
+    uint16_t delta;
+
+    if (savedLiters != CACHE_EMPTY){
+        delta = (liters > savedLiters) ? liters - savedLiters : savedLiters - liters;
+        if (delta < CACHE_MIN_DELTA || stamp - savedStamp < CACHE_MIN_PERIOD)
+            return;
+    }
+    eeprom_update_word(&ee_liters, liters);
+    eeprom_update_dword(&ee_stamp, stamp);
+    savedLiters = liters;
+    savedStamp = stamp;
+}
+
+void cache_boot_time(uint16_t ms){
+    eeprom_update_word(&ee_bootTime, ms);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+/* ---------------------------------------------------------------------------
+ * last reading kept in EEPROM, shown at power-on before the sensor settles
+ * ---------------------------------------------------------------------------*/
+
+#define CACHE_EMPTY         0xFFFF      // erased EEPROM, nothing cached yet
+#define CACHE_MIN_DELTA     70          // l, > 2 cm of level anywhere (22..32 l/cm), a 1 cm flicker never writes
+#define CACHE_MIN_PERIOD    600         // s between two writes
+
+uint8_t cache_load(uint16_t *liters, uint32_t *stamp);
+void cache_save(uint16_t liters, uint32_t stamp);
+void cache_boot_time(uint16_t ms);
@@ -0,0 +1,165 @@
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+
+#include "calib.h"
+#include "ring.h"
+
+/* ---------------------------------------------------------------------------
+ *
+ * A reference is the filtered distance d at a moment the volume is known:
+ * "filled to N liters" confirmed on the calibration page, or N written by
+ * the host into ee_refLiters with the programmer (avrdude -U eeprom:w:...),
+ * taken with the first reading after the next power-on and erased.
+ *
+ * Each liters value is turned into a depth by inverting the tank profile
+ * (bisection on cal_volume), then depth = mount - scale * x, x = d in mm,
+ * is fitted over all kept references by integer least squares:
+ *
+ *      scale = -sum((x - mx) * (y - my)) / sum((x - mx)^2)
+ *      mount = my + scale * mx
+ *
+ * The scale is only fitted when the references are CAL_SPREAD apart, one
+ * reference or references close together only move the mount. The result
+ * goes to EEPROM and is used by every reading from then on.
+ *
+ * Everything is 32 bit integer, the tank profile is a table : no float or
+ * 64 bit library code has to fit in the 8 KB of the ATtiny84/85.
+ *
+ * ---------------------------------------------------------------------------*/
+
+static struct cal_point EEMEM ee_points[CAL_POINTS];
+static uint8_t EEMEM ee_count;          // references stored
+static uint8_t EEMEM ee_next;           // slot for the next one
+static int16_t EEMEM ee_mount = -1;
+static uint16_t EEMEM ee_scale = CAL_NONE;
+static uint16_t EEMEM ee_refLiters = CAL_NONE;
+
+int16_t cal_mount = CAL_MOUNT;
+uint16_t cal_scale = CAL_UNITY;
+uint8_t cal_points;
+uint16_t cal_bottom = CAL_MOUNT / 10;
+uint16_t cal_pending = CAL_NONE;
+
+// lying cylinder, part of the volume below depth i/CAL_PROFILE of the
+// diameter, x 65535 : (acos(1 - 2u) - (1 - 2u) * sqrt(1 - (1 - 2u)^2)) / pi
+// linear in between stays within 4 l of that on this tank
+static const uint16_t profile[CAL_PROFILE + 1] PROGMEM = {
+        0,   609,  1705,  3102,  4728,  6540,  8506, 10604,
+    12812, 15115, 17497, 19945, 22447, 24991, 27566, 30162,
+    32768, 35373, 37969, 40544, 43088, 45590, 48038, 50420,
+    52723, 54931, 57029, 58995, 60807, 62433, 63830, 64926,
+    65535,
+};
+
+// depth 0 : d = mount / scale, back in cm
+static void bottom(void){
+    cal_bottom = ((int32_t)cal_mount * CAL_UNITY / 10 + cal_scale / 2) / cal_scale;
+}
+
+static void fit(void){
+    struct cal_point p;
+    int16_t x[CAL_POINTS], y[CAL_POINTS];   // mm, 16 bit keeps main's stack small
+    int32_t mx = 0, my = 0, sxx = 0, sxy = 0;
+    int32_t s = cal_scale;
+    uint8_t i, n = cal_points;
+
+    if (n == 0)
+        return;
+    for (i = 0; i < n; i++){
+        eeprom_read_block(&p, &ee_points[i], sizeof(p));
+        x[i] = p.d * 10;
+        y[i] = cal_depth_of(p.liters);
+        mx += x[i];
+        my += y[i];
+    }
+    mx = (mx + n / 2) / n;
+    my = (my + n / 2) / n;
+    for (i = 0; i < n; i++){
+        sxx += (x[i] - mx) * (x[i] - mx);
+        sxy += (x[i] - mx) * (y[i] - my);
+    }
+
+    if (n >= 2 && sxx >= (int32_t)CAL_SPREAD * CAL_SPREAD / 2){
+        while (sxy > 0x1FFFFF || sxy < -0x1FFFFF){    // room for * CAL_UNITY in 32 bit
+            sxy /= 2;
+            sxx /= 2;
+        }
+        s = -sxy * CAL_UNITY / sxx;
+        if (s < CAL_SCALE_MIN || s > CAL_SCALE_MAX)
+            s = cal_scale;              // keep the last good one, the mount still follows
+    }
+    cal_scale = s;
+    cal_mount = my + (mx * s + CAL_UNITY / 2) / CAL_UNITY;
+
+    bottom();
+
+    eeprom_update_word((uint16_t *)&ee_mount, cal_mount);
+    eeprom_update_word(&ee_scale, cal_scale);
+}
+
+void cal_init(void){
+    int16_t m = eeprom_read_word((uint16_t *)&ee_mount);
+    uint16_t s = eeprom_read_word(&ee_scale);
+
+    cal_points = eeprom_read_byte(&ee_count);
+    if (cal_points > CAL_POINTS)
+        cal_points = 0;                 // erased EEPROM
+    if (s >= CAL_SCALE_MIN && s <= CAL_SCALE_MAX && m > 0){
+        cal_mount = m;
+        cal_scale = s;
+    }
+    bottom();
+
+    cal_pending = eeprom_read_word(&ee_refLiters);
+    if (cal_pending != CAL_NONE)
+        eeprom_update_word(&ee_refLiters, CAL_NONE);
+}
+
+// mm of oil for a filtered distance d (cm)
+int16_t cal_depth(uint16_t d){
+    return cal_mount - (int16_t)(((int32_t)d * 10 * cal_scale + CAL_UNITY / 2) / CAL_UNITY);
+}
+
+// liters in the tank at a depth (mm), lying cylinder
+int cal_volume(int16_t depth){
+    uint16_t p, lo, hi;
+    uint8_t i;
+
+    if (depth <= 0)
+        return 0;
+    if (depth >= 2 * CAL_RADIUS * 10)
+        return TANK_LITERS;
+    p = (uint32_t)depth * CAL_PROFILE * 256 / (2 * CAL_RADIUS * 10);   // 8 bit fraction
+    i = p >> 8;
+    lo = pgm_read_word(&profile[i]);
+    hi = pgm_read_word(&profile[i + 1]);
+    p = lo + (((uint32_t)(hi - lo) * (p & 0xFF)) >> 8);
+    return ((uint32_t)p * TANK_LITERS + 32767) / 65535;
+}
+
+// depth (mm) holding a volume, cal_volume backwards
+int16_t cal_depth_of(uint16_t liters){
+    int16_t lo = 0, hi = 2 * CAL_RADIUS * 10, mid;
+
+    while (lo < hi){
+        mid = (lo + hi) / 2;
+        if (cal_volume(mid) < (int)liters)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// keep a reference and fit again, the oldest one goes when all are in use
+void cal_add(uint16_t d, uint16_t liters){
+    struct cal_point p;
+
+    p.d = d;
+    p.liters = liters;
+    ring_put(ee_points, &ee_next, &p, sizeof(p), CAL_POINTS);
+    if (cal_points < CAL_POINTS)
+        eeprom_update_byte(&ee_count, ++cal_points);
+    fit();
+}
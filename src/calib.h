@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+/* ---------------------------------------------------------------------------
+ * sensor mount offset and scale, fitted to readings taken at known volumes
+ *
+ *      depth (mm of oil) = cal_mount - d (cm) * 10 * cal_scale / CAL_UNITY
+ * ---------------------------------------------------------------------------*/
+
+#define CAL_MOUNT           1340        // mm, sensor above the tank bottom, measured by hand
+#define CAL_UNITY           1024        // cal_scale 1.0
+#define CAL_SCALE_MIN       922         // 0.9, a fit outside 0.9..1.1 is a bad reference
+#define CAL_SCALE_MAX       1126        // 1.1
+#define CAL_SPREAD          200         // mm between references before the scale is fitted too
+#define CAL_POINTS          4           // references kept in EEPROM
+#define CAL_STEP            100         // l per short press when entering a reference
+#define CAL_NONE            0xFFFF      // no reference waiting, erased EEPROM
+
+// tank : lying cylinder, the only copy of its size
+#define CAL_RADIUS          60          // cm
+#define CAL_LENGTH          265         // cm
+#define TANK_LITERS         ((uint16_t)(3.14159265 * CAL_RADIUS * CAL_RADIUS * CAL_LENGTH / 1000))
+#define CAL_PROFILE         32          // steps in the profile table over the diameter
+
+struct cal_point {
+    uint16_t d;                         // cm, filtered distance at the reference
+    uint16_t liters;                    // known volume
+};
+
+extern int16_t cal_mount;               // mm
+extern uint16_t cal_scale;              // x CAL_UNITY
+extern uint8_t cal_points;              // references the fit is based on
+extern uint16_t cal_bottom;             // cm, distance the tank bottom reads at
+extern uint16_t cal_pending;            // liters from the host mailbox, CAL_NONE when none
+
+void cal_init(void);
+int16_t cal_depth(uint16_t d);
+int cal_volume(int16_t depth);
+int16_t cal_depth_of(uint16_t liters);
+void cal_add(uint16_t d, uint16_t liters);
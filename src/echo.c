@@ -0,0 +1,132 @@
+#include <avr/io.h>
+
+#include "echo.h"
+
+/* ---------------------------------------------------------------------------
+ *
+ * The JSN-SR04T is mounted in the tank top and reports the first echo it
+ * hears. In practice that is not always the oil surface:
+ *      - below ~20 cm the transducer is still ringing (blind zone)
+ *      - the tank wall, baffles and the fill pipe give early echoes
+ *      - no echo at all gives a time-out (999), a stray edge gives 0
+ *
+ * A real level can only move as fast as the tank can be filled or drained,
+ * so a reading that moves further than that since the last accepted one is
+ * taken as a false echo. If the same new level keeps coming back
+ * ECHO_JUMP_CONFIRM times in a row we follow it (sensor re-mounted,
+ * refill while powered down, ...).
+ *
+ * ---------------------------------------------------------------------------*/
+
+struct echo_stats echo_stats;
+uint8_t echo_confidence;
+uint16_t echo_level;
+uint16_t echo_filtered;
+uint8_t echo_burst_len = ECHO_BURST;
+
+static uint8_t haveLevel;           // echo_level holds a reading
+static uint8_t jumpCount;           // consecutive agreeing jumps
+static uint16_t jumpLevel;          // level those jumps agree on
+static uint32_t sinceLevel;         // ms since the last accepted reading, up to SINCE_MAX
+static uint16_t burst[ECHO_BURST];  // accepted readings, kept sorted
+static uint8_t burstCount;
+
+// after an hour even the drain rate allows more than the whole tank,
+// stop counting there so sinceLevel * rate can't overflow
+#define SINCE_MAX       3600000UL
+
+static uint16_t diff(uint16_t a, uint16_t b){
+    return (a > b) ? a - b : b - a;
+}
+
+static void accept(uint16_t d){
+    echo_level = d;
+    haveLevel = 1;
+    jumpCount = 0;
+    sinceLevel = 0;
+    echo_stats.accepted++;
+    if (echo_confidence <= ECHO_CONF_MAX - ECHO_CONF_UP)
+        echo_confidence += ECHO_CONF_UP;
+    else
+        echo_confidence = ECHO_CONF_MAX;
+}
+
+static uint8_t reject(uint8_t class, uint16_t *counter){
+    (*counter)++;
+    if (echo_confidence >= ECHO_CONF_DOWN)
+        echo_confidence -= ECHO_CONF_DOWN;
+    else
+        echo_confidence = 0;
+    return class;
+}
+
+/*
+ * d  : distance from srf04 (cm)
+ * dt : ms since the previous call (pace can make that minutes)
+ * returns ECHO_OK when d may be used, otherwise the reason it was dropped
+ */
+uint8_t echo_classify(uint16_t d, uint32_t dt){
+    uint32_t allowed;
+
+    if (dt < SINCE_MAX - sinceLevel)
+        sinceLevel += dt;
+    else
+        sinceLevel = SINCE_MAX;
+
+    if (d == ECHO_NO_ECHO)
+        return reject(ECHO_TIMEOUT, &echo_stats.timeout);
+    if (d == 0)
+        return reject(ECHO_SPURIOUS, &echo_stats.spurious);
+    if (d < ECHO_BLIND_ZONE)
+        return reject(ECHO_BLIND, &echo_stats.blind);
+    if (d > ECHO_MAX_RANGE)
+        return reject(ECHO_RANGE, &echo_stats.range);
+
+    if (!haveLevel){
+        accept(d);
+        return ECHO_OK;
+    }
+
+    // distance shrinks while filling, grows while draining
+    if (d < echo_level)
+        allowed = ECHO_NOISE + (sinceLevel * ECHO_MAX_FILL_RATE) / 60000;
+    else
+        allowed = ECHO_NOISE + (sinceLevel * ECHO_MAX_DRAIN_RATE) / 60000;
+
+    if (diff(d, echo_level) <= allowed){
+        accept(d);
+        return ECHO_OK;
+    }
+
+    if (jumpCount && diff(d, jumpLevel) <= ECHO_NOISE){
+        if (++jumpCount >= ECHO_JUMP_CONFIRM){
+            accept(d);
+            return ECHO_OK;
+        }
+    }else{
+        jumpCount = 1;
+    }
+    jumpLevel = d;
+    return reject(ECHO_JUMP, &echo_stats.jump);
+}
+
+/*
+ * collect accepted readings, every echo_burst_len of them give one filtered
+ * reading in echo_filtered (median, a single odd echo can't move it)
+ * returns 1 when echo_filtered was updated
+ */
+uint8_t echo_burst(uint16_t d){
+    uint8_t i = burstCount;
+
+    while (i > 0 && burst[i-1] > d){    // insertion sort
+        burst[i] = burst[i-1];
+        i--;
+    }
+    burst[i] = d;
+
+    if (++burstCount < echo_burst_len)
+        return 0;
+    echo_filtered = burst[burstCount / 2];
+    burstCount = 0;
+    return 1;
+}
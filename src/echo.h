@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "calib.h"
+
+/* ---------------------------------------------------------------------------
+ * echo classification for the JSN-SR04T-2.0 (doc/JSN-SR04T-2.0.pdf)
+ *
+ * srf04.c takes the first falling edge as the distance. This layer decides
+ * whether that distance can be trusted before it reaches the volume stage.
+ * ---------------------------------------------------------------------------*/
+
+#define ECHO_BLIND_ZONE         20      // cm, sensor rings too long to see closer targets
+#define ECHO_MAX_RANGE          (cal_bottom + ECHO_NOISE)   // cm, tank bottom as calibrated
+#define ECHO_NO_ECHO            999     // distance srf04 reports on a time-out
+
+#define ECHO_NOISE              2       // cm, jitter allowed on a static level
+#define ECHO_MAX_FILL_RATE      30      // cm/min, delivery pump ~500 l/min at the narrowest part
+#define ECHO_MAX_DRAIN_RATE     5       // cm/min, nothing legal empties the tank faster
+#define ECHO_JUMP_CONFIRM       5       // consecutive agreeing jumps before we believe them
+
+#define ECHO_BURST              5       // accepted echoes per filtered reading (median), at most
+
+#define ECHO_CONF_MAX           100
+#define ECHO_CONF_UP            10      // confidence gained per accepted echo
+#define ECHO_CONF_DOWN          20      // confidence lost per rejected echo
+
+// reading classes
+#define ECHO_OK         0
+#define ECHO_TIMEOUT    1               // no echo within 38 ms
+#define ECHO_SPURIOUS   2               // edge without a ping, srf04 reports 0
+#define ECHO_BLIND      3               // inside the blind zone
+#define ECHO_RANGE      4               // beyond the tank bottom
+#define ECHO_JUMP       5               // faster than the tank can fill or drain (wall/baffle echo)
+
+struct echo_stats {
+    uint16_t accepted;
+    uint16_t timeout;
+    uint16_t spurious;
+    uint16_t blind;
+    uint16_t range;
+    uint16_t jump;
+};
+
+extern struct echo_stats echo_stats;   // rejection counters, for diagnostics
+extern uint8_t echo_confidence;         // 0..ECHO_CONF_MAX
+extern uint16_t echo_level;             // last accepted distance (cm)
+extern uint16_t echo_filtered;          // median of the last complete burst (cm)
+extern uint8_t echo_burst_len;          // echoes per burst, 1..ECHO_BURST
+
+uint8_t echo_classify(uint16_t d, uint32_t dt);
+uint8_t echo_burst(uint16_t d);
@@ -0,0 +1,145 @@
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "event.h"
+#include "ring.h"
+
+/* ---------------------------------------------------------------------------
+ *
+ * Fixed state, no history buffer:
+ *      level   : liters, smoothed (EWMA 1/4, kept x8)
+ *      ref     : level at the start of the current window
+ *
+ *  IDLE    level > ref + EV_RISE                   -> RISING
+ *          level < ref - EV_DROP within EV_WINDOW  -> FALLING
+ *          EV_WINDOW passed                        -> ref = level (burner use)
+ *  RISING  new maximum resets the plateau timer, EV_PLATEAU without one
+ *          ends the refill : delivered = level - ref
+ *  FALLING same with the minimum : lost = ref - level
+ *
+ * Every quiet window also gives the consumption, ref - level over the
+ * window, which is averaged (1/4) into event_rate.
+ *
+ * A finished event goes into a ring of EV_LOG records in EEPROM (ring.c,
+ * ee_log/ee_next, read out with the programmer) and latches event_alarm
+ * until event_ack().
+ *
+ * ---------------------------------------------------------------------------*/
+
+#define EV_IDLE     0
+#define EV_RISING   1
+#define EV_FALLING  2
+
+static struct event_record EEMEM ee_log[EV_LOG];
+static uint8_t EEMEM ee_next;           // next record to write
+
+uint8_t event_alarm;
+int16_t event_amount;
+int16_t event_rate;
+
+static uint8_t state;
+static uint8_t haveRef;
+static int16_t level8;                  // liters x8
+static int16_t ref;
+static uint32_t refTime;
+static int16_t extreme;                 // highest (rising) or lowest (falling) level so far
+static uint32_t extremeTime;
+
+static void record(uint8_t type, int16_t amount, uint32_t t){
+    struct event_record r;
+
+    r.stamp = t;
+    r.liters = amount;
+    ring_put(ee_log, &ee_next, &r, sizeof(r), EV_LOG);
+
+    event_alarm = type;
+    event_amount = amount;
+}
+
+/*
+ * liters : filtered reading
+ * t      : s since 2000-01-01
+ * returns the type of an event that just ended, EV_NONE otherwise
+ */
+uint8_t event_update(int16_t liters, uint32_t t){
+    int16_t level;
+    int32_t rate;
+    uint8_t type = EV_NONE;
+
+    if (!haveRef){
+        haveRef = 1;
+        level8 = liters * 8;
+        ref = liters;
+        refTime = t;
+        return EV_NONE;
+    }
+    level8 += (liters * 8 - level8) / 4;
+    level = level8 / 8;
+
+    switch (state){
+    case EV_IDLE:
+        if (level > ref + EV_RISE){
+            state = EV_RISING;
+        }else if (level < ref - EV_DROP){
+            state = EV_FALLING;
+        }else{
+            if (t - refTime >= EV_WINDOW){
+                // signed division, a level that crept up gives a rate < 0
+                rate = (int32_t)(ref - level) * 86400 / (int32_t)(t - refTime);
+                if (rate > INT16_MAX)
+                    rate = INT16_MAX;
+                else if (rate < INT16_MIN)
+                    rate = INT16_MIN;
+                if (event_rate == 0)
+                    event_rate = rate;
+                else
+                    event_rate += (rate - event_rate) / 4;
+                ref = level;
+                refTime = t;
+            }
+            return EV_NONE;
+        }
+        extreme = level;
+        extremeTime = t;
+        return EV_NONE;
+
+    case EV_RISING:
+        if (level > extreme + EV_NOISE){
+            extreme = level;
+            extremeTime = t;
+        }
+        if (t - extremeTime < EV_PLATEAU)
+            return EV_NONE;
+        if (level - ref >= EV_RISE)        // not just a ripple on the way up
+            type = EV_REFILL;
+        break;
+
+    case EV_FALLING:
+        if (level < extreme - EV_NOISE){
+            extreme = level;
+            extremeTime = t;
+        }
+        if (t - extremeTime < EV_PLATEAU)
+            return EV_NONE;
+        if (ref - level >= EV_DROP)
+            type = EV_LOSS;
+        break;
+    }
+
+    if (type != EV_NONE)
+        record(type, level - ref, t);
+    state = EV_IDLE;
+    ref = level;
+    refTime = t;
+    return type;
+}
+
+void event_ack(void){
+    event_alarm = EV_NONE;
+}
+
+// start over from the next reading, e.g. after a recalibration moved them all
+void event_reset(void){
+    haveRef = 0;
+    state = EV_IDLE;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+/* ---------------------------------------------------------------------------
+ * refill and leak/theft detection on the filtered liter series
+ * ---------------------------------------------------------------------------*/
+
+#define EV_NOISE            30          // l, one cm of level is 20..30 l
+#define EV_RISE             100         // l above the reference starts a refill
+#define EV_DROP             50          // l lost within EV_WINDOW is not the burner
+#define EV_WINDOW           7200        // s, reference follows normal consumption this often
+#define EV_PLATEAU          120         // s without further change ends an event
+#define EV_LOG              8           // events kept in EEPROM
+
+// event types
+#define EV_NONE             0
+#define EV_REFILL           1
+#define EV_LOSS             2
+
+struct event_record {
+    uint32_t stamp;                     // s since 2000-01-01, end of the event
+    int16_t liters;                     // > 0 delivered, < 0 lost
+};
+
+extern uint8_t event_alarm;             // latched type of the last event, EV_NONE when acknowledged
+extern int16_t event_amount;            // liters of the last event
+extern int16_t event_rate;              // l/day used, averaged over quiet windows, 0 until known
+
+uint8_t event_update(int16_t liters, uint32_t t);
+void event_ack(void);
+void event_reset(void);
@@ -0,0 +1,53 @@
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "gauge.h"
+#include "lcd.h"
+
+/* ---------------------------------------------------------------------------
+ *
+ * Cells left of the level are the ROM full block (0xFF), cells right of it
+ * a space and the cell holding the level one of four glyphs with 1..4
+ * columns lit over all 8 rows, as tall as the block. The glyphs never
+ * change, so a new level only changes the boundary cell and the cells it
+ * crossed, the frame buffer sends just those (two bus writes for a one
+ * step move).
+ *
+ * ---------------------------------------------------------------------------*/
+
+#define GAUGE_FULL      0xFF            // HD44780 ROM A00 full block
+
+static const uint8_t bar1[8] PROGMEM = { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 };
+static const uint8_t bar2[8] PROGMEM = { 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18 };
+static const uint8_t bar3[8] PROGMEM = { 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C };
+static const uint8_t bar4[8] PROGMEM = { 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E };
+
+// the gauge owns CGRAM slots 0..3 (GAUGE_GLYPH), the histogram 4..7
+void gauge_init(void){
+    lcd_glyph_define(GAUGE_GLYPH + 0, bar1);
+    lcd_glyph_define(GAUGE_GLYPH + 1, bar2);
+    lcd_glyph_define(GAUGE_GLYPH + 2, bar3);
+    lcd_glyph_define(GAUGE_GLYPH + 3, bar4);
+}
+
+// steps : 0..GAUGE_STEPS
+void gauge_draw(uint8_t line, uint8_t steps){
+    uint8_t text[lcd_Columns+1];
+    uint8_t full, part, i;
+
+    if (steps > GAUGE_STEPS)
+        steps = GAUGE_STEPS;
+    full = steps / 5;
+    part = steps % 5;
+
+    for (i = 0; i < lcd_Columns; i++){
+        if (i < full)
+            text[i] = GAUGE_FULL;
+        else if (i == full && part)
+            text[i] = lcd_GlyphChar + GAUGE_GLYPH + part - 1;
+        else
+            text[i] = ' ';
+    }
+    text[i] = 0;
+    lcd_frame_write(line, 0, text);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+/* ---------------------------------------------------------------------------
+ * horizontal tank gauge over a full LCD line
+ * 16 cells x 5 pixel columns = 80 steps
+ * ---------------------------------------------------------------------------*/
+
+#define GAUGE_STEPS         80
+#define GAUGE_GLYPH         0           // first of the 4 glyphs used (1..4 columns filled)
+
+void gauge_init(void);
+void gauge_draw(uint8_t line, uint8_t steps);
@@ -0,0 +1,90 @@
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+
+#include "health.h"
+#include "lcd.h"
+
+/* ---------------------------------------------------------------------------
+ *
+ * The counters live in RAM and go to EEPROM in one batch every HEALTH_SAVE
+ * s, only when one of them moved. eeprom_update_block skips unchanged
+ * bytes, a busy counter costs its own cells a write an hour at most.
+ *
+ * health_init() must run before rtc_init(), which clears WDRF in MCUSR.
+ * The reset that just happened is counted and saved at once, a unit that
+ * keeps resetting would otherwise never reach the first batch.
+ *
+ * LCD busy flag time-outs are counted in lcd.c (lcd_bf_timeouts, from the
+ * tick interrupt), health_service() adds what came in since the last call.
+ *
+ * ---------------------------------------------------------------------------*/
+
+static uint16_t EEMEM ee_magic;
+static uint16_t EEMEM ee_health[HEALTH_COUNTERS];
+
+uint16_t health[HEALTH_COUNTERS];
+uint8_t health_mcusr;
+
+static uint8_t dirty;
+static uint32_t lastSave;
+static uint16_t lcdSeen;                // lcd_bf_timeouts already counted
+
+void health_init(void){
+    health_mcusr = MCUSR;
+    MCUSR = 0;
+
+    if (eeprom_read_word(&ee_magic) == HEALTH_MAGIC)
+        eeprom_read_block(health, ee_health, sizeof(health));
+
+    if (health_mcusr & (1 << PORF)){
+        health_count(HEALTH_RESET_POWER);   // BORF may come along, not a brown-out
+    }else{
+        if (health_mcusr & (1 << EXTRF))
+            health_count(HEALTH_RESET_EXT);
+        if (health_mcusr & (1 << BORF))
+            health_count(HEALTH_RESET_BROWN);
+        if (health_mcusr & (1 << WDRF))
+            health_count(HEALTH_RESET_WDT);
+    }
+    health_save();
+}
+
+void health_count(uint8_t n){
+    if (health[n] != HEALTH_MAX){
+        health[n]++;
+        dirty = 1;
+    }
+}
+
+// call from the main loop, t : s since 2000-01-01
+void health_service(uint32_t t){
+    uint16_t bf;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        bf = lcd_bf_timeouts;
+    }
+    while (lcdSeen != bf){
+        lcdSeen++;
+        health_count(HEALTH_LCD_BF);
+    }
+    if (dirty && t - lastSave >= HEALTH_SAVE){
+        lastSave = t;
+        health_save();
+    }
+}
+
+// batch now, e.g. before a long power-down
+void health_save(void){
+    eeprom_update_word(&ee_magic, HEALTH_MAGIC);
+    eeprom_update_block(health, ee_health, sizeof(health));
+    dirty = 0;
+}
+
+void health_clear(void){
+    uint8_t n;
+
+    for (n = 0; n < HEALTH_COUNTERS; n++)
+        health[n] = 0;
+    health_save();
+}
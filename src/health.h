@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+/* ---------------------------------------------------------------------------
+ * persistent fault counters, they survive resets and power cuts
+ * ---------------------------------------------------------------------------*/
+
+#define HEALTH_SAVE         3600        // s between two EEPROM batches
+#define HEALTH_MAX          0xFFFF      // counters stop here
+#define HEALTH_MAGIC        0x4854      // ee_magic, anything else is a blank EEPROM
+
+// counters
+#define HEALTH_TIMEOUT      0           // sonar time-outs (no echo)
+#define HEALTH_REJECT       1           // echoes echo_classify dropped otherwise
+#define HEALTH_LCD_BF       2           // LCD busy flag time-outs
+#define HEALTH_ADC_RANGE    3           // pressure input at either rail (open or shorted sensor)
+#define HEALTH_RESET_POWER  4           // resets by cause, from MCUSR
+#define HEALTH_RESET_EXT    5
+#define HEALTH_RESET_BROWN  6
+#define HEALTH_RESET_WDT    7
+#define HEALTH_COUNTERS     8
+
+extern uint16_t health[HEALTH_COUNTERS];
+extern uint8_t health_mcusr;            // MCUSR at the last reset
+
+void health_init(void);
+void health_count(uint8_t n);
+void health_service(uint32_t t);
+void health_save(void);
+void health_clear(void);
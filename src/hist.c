@@ -0,0 +1,102 @@
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+
+#include "hist.h"
+#include "board.h"
+#include "srf04.h"
+#include "lcd.h"
+
+/* ---------------------------------------------------------------------------
+ *
+ * Every ping goes into the histogram before echo.c sees it, so it shows
+ * the echoes the filter throws away: a second peak is a baffle, the fill
+ * pipe or the tank wall, a smear near the blind zone is condensation on the
+ * transducer. The bins count raw timer ticks, HIST_BIN_CM wide, counters
+ * stop at 0xFFFF.
+ *
+ * On the LCD each bin is one column, bar height relative to the largest
+ * bin: space, 1, 2, 4, 6 rows (glyphs) or the ROM full block.
+ *
+ * hist_save() copies the histogram to ee_hist, read it out with the
+ * programmer (avrdude -U eeprom:r:...), there is no serial port.
+ *
+ * ---------------------------------------------------------------------------*/
+
+// 17 cm per ms of echo (there and back), multiply before dividing so the
+// bins stay HIST_BIN_CM wide and bin 14 still holds the tank bottom
+#define HIST_CM_TICKS       ((SONAR_TICKS_PER_MS + 8) / 17)     // ticks per cm, rounded
+#define HIST_BIN_TICKS      (SONAR_TICKS_PER_MS * HIST_BIN_CM / 17)
+#define HIST_FULL           0xFF                                // HD44780 ROM A00 full block
+
+struct hist hist;
+static struct hist EEMEM ee_hist;
+
+static const uint8_t rows1[8] PROGMEM = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F };
+static const uint8_t rows2[8] PROGMEM = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F };
+static const uint8_t rows4[8] PROGMEM = { 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F, 0x1F };
+static const uint8_t rows6[8] PROGMEM = { 0x00, 0x00, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F };
+
+static void count(uint16_t *c){
+    if (*c != 0xFFFF)
+        (*c)++;
+}
+
+// the histogram owns CGRAM slots 4..7 (HIST_GLYPH), the gauge 0..3
+void hist_init(void){
+    lcd_glyph_define(HIST_GLYPH + 0, rows1);
+    lcd_glyph_define(HIST_GLYPH + 1, rows2);
+    lcd_glyph_define(HIST_GLYPH + 2, rows4);
+    lcd_glyph_define(HIST_GLYPH + 3, rows6);
+}
+
+// ticks : echoTicks of a finished ping
+void hist_add(uint32_t ticks){
+    uint32_t b;
+
+    if (ticks == SONAR_NO_ECHO){
+        count(&hist.timeout);
+    }else if (ticks < HIST_CM_TICKS){
+        count(&hist.zero);
+    }else{
+        b = ticks / HIST_BIN_TICKS;
+        count(&hist.bin[(b < HIST_BINS) ? b : HIST_BINS - 1]);
+    }
+}
+
+void hist_clear(void){
+    uint8_t *p = (uint8_t *)&hist;
+    uint8_t i;
+
+    for (i = 0; i < sizeof(hist); i++)
+        p[i] = 0;
+}
+
+void hist_save(void){
+    eeprom_update_block(&hist, &ee_hist, sizeof(hist));
+}
+
+void hist_draw(uint8_t line){
+    uint8_t text[lcd_Columns+1];
+    uint16_t max = 1;
+    uint8_t i, h;
+
+    for (i = 0; i < HIST_BINS; i++)
+        if (hist.bin[i] > max)
+            max = hist.bin[i];
+
+    for (i = 0; i < HIST_BINS && i < lcd_Columns; i++){
+        // 0..5, anything counted shows at least one row
+        h = ((uint32_t)hist.bin[i] * 5 + max - 1) / max;
+        if (h == 0)
+            text[i] = ' ';
+        else if (h == 5)
+            text[i] = HIST_FULL;
+        else
+            text[i] = lcd_GlyphChar + HIST_GLYPH + h - 1;
+    }
+    while (i < lcd_Columns)
+        text[i++] = ' ';
+    text[i] = 0;
+    lcd_frame_write(line, 0, text);
+}
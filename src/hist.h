@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+/* ---------------------------------------------------------------------------
+ * histogram of the raw echo times, what the sensor actually hears
+ * ---------------------------------------------------------------------------*/
+
+#define HIST_BINS           16          // one per LCD column
+#define HIST_BIN_CM         9           // bin width, 15 bins reach the tank bottom (~134 cm)
+#define HIST_GLYPH          4           // first of the 4 glyphs used (1, 2, 4, 6 rows)
+
+struct hist {
+    uint16_t bin[HIST_BINS];            // echo times by distance, the last bin catches the rest
+    uint16_t timeout;                   // no echo
+    uint16_t zero;                      // echo shorter than 1 cm
+};
+
+extern struct hist hist;
+
+void hist_init(void);
+void hist_add(uint32_t ticks);
+void hist_clear(void);
+void hist_save(void);
+void hist_draw(uint8_t line);
@@ -71,8 +71,38 @@
 
 #include <avr/io.h>
 #include <util/delay.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
 #include "lcd.h"
 
+#ifdef lcd_SR
+#define lcd_latch()     lcd_sr_flush()              // E, RS and data only change when shifted out
+#else
+#define lcd_latch()
+#endif
+
+#ifdef lcd_NoRW
+#define lcd_RW_low()                                // RW tied to GND
+#else
+#define lcd_RW_low()    lcd_RW_port &= ~(1<<lcd_RW_bit)
+#endif
+
+uint16_t lcd_bf_timeouts;                           // health counter, busy flag time-outs since reset
+#ifdef lcd_NoRW
+uint8_t lcd_timed = 1;                              // 1: no RW readback, data sheet delays instead
+#else
+uint8_t lcd_timed;                                  // 1: no RW readback, data sheet delays instead
+#endif
+static uint8_t lcd_bf_fails;                        // consecutive time-outs
+static uint8_t lcd_probe;                           // timed writes left before the busy flag is tried again
+static uint8_t lcd_slow;                            // last instruction was Clear or Home
+static uint8_t lcd_busy_ticks;                      // lcd_service calls the busy flag stayed set
+static volatile uint8_t lcd_powered;                // controller initialized and supplied, lcd_service may write
+static volatile uint8_t lcd_onoff;                  // lcd_DisplayOn/Off waiting for lcd_service, 0 = none
+
+static void lcd_bf_timeout(void);
+static void lcd_timed_wait(void);
+
 /*============================== 4-bit LCD Functions ======================*/
 /*
   Name:     lcd_init
@@ -83,6 +113,14 @@
 */
 void lcd_init(void)
 {
+    lcd_powered = 0;                                // keep lcd_service off the bus
+    lcd_onoff = 0;
+#ifdef lcd_SR
+// configure the microprocessor pins for the shift register
+    lcd_SR_ddr |= (1<<lcd_SR_clock) | (1<<lcd_SR_latch);
+    lcd_sr |= (1<<lcd_SR_Power);                    // LCD supply on
+    lcd_sr_flush();
+#else
 // configure the microprocessor pins for the data lines
     lcd_D7_ddr |= (1<<lcd_D7_bit);                  // 4 data lines - output
     lcd_D6_ddr |= (1<<lcd_D6_bit);
@@ -93,6 +131,11 @@ void lcd_init(void)
     lcd_E_ddr |= (1<<lcd_E_bit);                    // E line - output
     lcd_RS_ddr |= (1<<lcd_RS_bit);                  // RS line - output
     lcd_RW_ddr |= (1<<lcd_RW_bit);                  // RW line - output
+#endif
+#ifdef lcd_BL_port
+    lcd_BL_ddr |= (1<<lcd_BL_bit);                  // backlight on
+    lcd_BL_port |= (1<<lcd_BL_bit);
+#endif
        
 // Power-up delay
     _delay_ms(100);                                 // initial 40 mSec delay
@@ -115,7 +158,7 @@ void lcd_init(void)
 // Set up the RS, E, and RW lines for the 'lcd_write_4' function.
     lcd_RS_port &= ~(1<<lcd_RS_bit);                // select the Instruction Register (RS low)
     lcd_E_port &= ~(1<<lcd_E_bit);                  // make sure E is initially low
-    lcd_RW_port &= ~(1<<lcd_RW_bit);                // write to LCD module (RW low)
+    lcd_RW_low();                                   // write to LCD module (RW low)
 
 // Reset the LCD controller
     lcd_write(lcd_FunctionReset);                 // first part of reset sequence
@@ -162,6 +205,9 @@ void lcd_init(void)
 // Display On/Off Control instruction
     lcd_check_BF();
     lcd_write_instruction(lcd_DisplayOn);        // turn the display ON
+
+    lcd_frame_reset();                              // display is blank, so is the frame buffer
+    lcd_powered = 1;
 }
 
 /*...........................................................................
@@ -176,8 +222,7 @@ void lcd_write_string(uint8_t theString[])
     volatile int i = 0;                             // character counter*/
     while (theString[i] != 0)
     {
-        lcd_check_BF();                           // make sure LCD controller is ready 
-        lcd_write_character(theString[i]);
+        lcd_write_character(theString[i]);          // checks if LCD controller is ready
         i++;
     }
 }
@@ -192,7 +237,7 @@ void lcd_write_string(uint8_t theString[])
 void lcd_write_character(uint8_t theData)
 {
     lcd_check_BF();
-    lcd_RW_port &= ~(1<<lcd_RW_bit);                // write to LCD module (RW low)
+    lcd_RW_low();                                   // write to LCD module (RW low)
     lcd_RS_port |= (1<<lcd_RS_bit);                 // select the Data Register (RS high)
     lcd_E_port &= ~(1<<lcd_E_bit);                  // make sure E is initially low
     lcd_write(theData);                             // write the upper 4-bits of the data
@@ -209,7 +254,8 @@ void lcd_write_character(uint8_t theData)
 void lcd_write_instruction(uint8_t theInstruction)
 {
     lcd_check_BF();
-    lcd_RW_port &= ~(1<<lcd_RW_bit);                // write to LCD module (RW low)
+    lcd_slow = (theInstruction == lcd_Clear) || ((theInstruction & 0b11111110) == lcd_Home);
+    lcd_RW_low();                                   // write to LCD module (RW low)
     lcd_RS_port &= ~(1<<lcd_RS_bit);                // select the Instruction Register (RS low)
     lcd_E_port &= ~(1<<lcd_E_bit);                  // make sure E is initially low
     lcd_write(theInstruction);                    // write the upper 4-bits of the data
@@ -225,9 +271,15 @@ void lcd_write_instruction(uint8_t theInstruction)
             RW is low
   Exit:     no parameters
   Notes:    use either time delays or the busy flag
+            with lcd_D4_shared D4 is only an output for the write and
+            goes back to input with pull-up, a button to GND (through 10k)
+            can share it
 */
 void lcd_write(uint8_t theByte)
 {
+#ifdef lcd_D4_shared
+    lcd_D4_ddr |= (1<<lcd_D4_bit);                          // D4 output for this nibble
+#endif
     lcd_D7_port &= ~(1<<lcd_D7_bit);                        // assume data is '0'
     if (theByte & 1<<7) lcd_D7_port |= (1<<lcd_D7_bit);     // make data = '1' if required
 
@@ -241,52 +293,396 @@ void lcd_write(uint8_t theByte)
     if (theByte & 1<<4) lcd_D4_port |= (1<<lcd_D4_bit);
 
     // write the data
-                                                    // 'Address set-up time' (40 nS)
+    lcd_latch();                                    // 'Address set-up time' (40 nS)
     lcd_E_port |= (1<<lcd_E_bit);                   // Enable pin high
+    lcd_latch();
     _delay_us(1);                                   // implement 'Data set-up time' (80 nS) and 'Enable pulse width' (230 nS)
     lcd_E_port &= ~(1<<lcd_E_bit);                  // Enable pin low
+    lcd_latch();
     _delay_us(1);                                   // implement 'Data hold time' (10 nS) and 'Enable cycle time' (500 nS)
+#ifdef lcd_D4_shared
+    lcd_D4_ddr &= ~(1<<lcd_D4_bit);                 // back to input
+    lcd_D4_port |= (1<<lcd_D4_bit);                 // with pull-up
+#endif
 }
 
 /*...........................................................................
   Name:     lcd_check_BF
   Purpose:  check busy flag, wait until LCD is ready
   Entry:    no parameters
+  Exit:     0 when the LCD is ready, 1 when the busy flag did not clear in time
+  Notes:    polls at most lcd_BF_Budget times, a defective or missing LCD costs
+            a bounded delay instead of hanging the program
+            after lcd_BF_MaxFails time-outs in a row the RW readback is given up
+            and the data sheet execution times are used (timed mode), every
+            lcd_Redetect writes the busy flag is tried again
+*/
+uint8_t lcd_check_BF(void)
+{
+#ifdef lcd_NoRW
+    lcd_timed_wait();                               // no RW line, always timed
+    return 0;
+#else
+    uint16_t budget;
+
+    if (lcd_timed && --lcd_probe)
+    {
+        lcd_timed_wait();
+        return 0;
+    }
+
+    for (budget = lcd_BF_Budget; budget; budget--)
+    {
+        if (!lcd_read_BF())
+        {
+            lcd_bf_fails = 0;                       // LCD answers, (back to) busy flag mode
+            lcd_timed = 0;
+            return 0;
+        }
+        _delay_us(lcd_BF_Poll_us);
+    }
+    lcd_bf_timeout();
+    return 1;
+#endif
+}
+
+/*...........................................................................
+  Name:     lcd_timed_wait
+  Purpose:  wait the data sheet execution time of the last write
+  Entry:    no parameters
+  Exit:     no parameters
+*/
+static void lcd_timed_wait(void)
+{
+    if (lcd_slow)                                   // Clear and Home take 1.52 mS
+        _delay_ms(2);
+    else
+        _delay_us(50);                              // everything else 37 uS
+}
+
+/*...........................................................................
+  Name:     lcd_bf_timeout
+  Purpose:  book a busy flag time-out, switch to timed mode when they keep coming
+  Entry:    no parameters
   Exit:     no parameters
-  Notes:    main program will hang if LCD module is defective or missing
-            data is read while 'E' is high
+*/
+static void lcd_bf_timeout(void)
+{
+    if (lcd_bf_timeouts < 0xFFFF)
+        lcd_bf_timeouts++;
+    if (lcd_bf_fails < lcd_BF_MaxFails)
+        lcd_bf_fails++;
+    if (lcd_bf_fails >= lcd_BF_MaxFails)
+        lcd_timed = 1;
+    lcd_probe = lcd_Redetect;
+}
+
+/*...........................................................................
+  Name:     lcd_read_BF
+  Purpose:  read the busy flag once
+  Entry:    no parameters
+  Exit:     non-zero while the LCD controller is busy
+  Notes:    data is read while 'E' is high
             both nibbles must be read even though desired information is only in the high nibble
 */
-void lcd_check_BF(void)
+uint8_t lcd_read_BF(void)
 {
+#ifdef lcd_NoRW
+    return 0;                                       // nothing to read, see lcd_check_BF
+#else
     uint8_t busy_flag_copy;                         // busy flag 'mirror'
 
     lcd_D7_ddr &= ~(1<<lcd_D7_bit);                 // set D7 data direction to input
+    lcd_D7_port |= (1<<lcd_D7_bit);                 // pull-up, a missing LCD reads as busy
     lcd_RS_port &= ~(1<<lcd_RS_bit);                // select the Instruction Register (RS low)
     lcd_RW_port |= (1<<lcd_RW_bit);                 // read from LCD module (RW high)
 
-    do
-    {
-        busy_flag_copy = 0;                         // initialize busy flag 'mirror'
-        lcd_E_port |= (1<<lcd_E_bit);               // Enable pin high
-        _delay_us(1);                               // implement 'Delay data time' (160 nS) and 'Enable pulse width' (230 nS)
+    busy_flag_copy = 0;                             // initialize busy flag 'mirror'
+    lcd_E_port |= (1<<lcd_E_bit);                   // Enable pin high
+    _delay_us(1);                                   // implement 'Delay data time' (160 nS) and 'Enable pulse width' (230 nS)
+
+    busy_flag_copy |= (lcd_D7_pin & (1<<lcd_D7_bit));  // get actual busy flag status
 
-        busy_flag_copy |= (lcd_D7_pin & (1<<lcd_D7_bit));  // get actual busy flag status
+    lcd_E_port &= ~(1<<lcd_E_bit);                  // Enable pin low
+    _delay_us(1);                                   // implement 'Address hold time' (10 nS), 'Data hold time' (10 nS), and 'Enable cycle time' (500 nS )
 
-        lcd_E_port &= ~(1<<lcd_E_bit);              // Enable pin low
-        _delay_us(1);                               // implement 'Address hold time' (10 nS), 'Data hold time' (10 nS), and 'Enable cycle time' (500 nS )
-        
 // read and discard alternate nibbles (D3 information)
-        lcd_E_port |= (1<<lcd_E_bit);               // Enable pin high
-        _delay_us(1);                               // implement 'Delay data time' (160 nS) and 'Enable pulse width' (230 nS)
-        lcd_E_port &= ~(1<<lcd_E_bit);              // Enable pin low
-        _delay_us(1);                               // implement 'Address hold time (10 nS), 'Data hold time' (10 nS), and 'Enable cycle time' (500 nS )
-        
-    } while (busy_flag_copy);                       // check again if busy flag was high
-
-// arrive here if busy flag is clear -  clean up and return 
+    lcd_E_port |= (1<<lcd_E_bit);                   // Enable pin high
+    _delay_us(1);                                   // implement 'Delay data time' (160 nS) and 'Enable pulse width' (230 nS)
+    lcd_E_port &= ~(1<<lcd_E_bit);                  // Enable pin low
+    _delay_us(1);                                   // implement 'Address hold time (10 nS), 'Data hold time' (10 nS), and 'Enable cycle time' (500 nS )
+
+// clean up and return
     lcd_RW_port &= ~(1<<lcd_RW_bit);                // write to LCD module (RW low)
     lcd_D7_ddr |= (1<<lcd_D7_bit);                  // reset D7 data direction to output
+    return busy_flag_copy;
+#endif
+}
+
+#ifdef lcd_SR
+/*============================== Shift register ============================*/
+/*
+    74HC595 : SER, SRCLK and RCLK from the uP, Q0..Q7 as in board.h.
+    lcd_sr is the image of Q0..Q7, the pin macros in board.h point at it and
+    lcd_sr_flush() makes the outputs follow, all at the same time on RCLK.
+    SER idles as input with pull-up, a button to GND (through 10k) can
+    share the pin, the uP drives over it while shifting.
+*/
+uint8_t lcd_sr;
+
+/*...........................................................................
+  Name:     lcd_sr_flush
+  Purpose:  copy lcd_sr to the shift register outputs
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    not interrupt safe, lcd_sr_aux is the one to use outside the LCD routines
+*/
+void lcd_sr_flush(void)
+{
+    uint8_t i, b = lcd_sr;
+
+    lcd_SR_ddr |= (1<<lcd_SR_data);                 // SER output while shifting
+    for (i = 0; i < 8; i++)
+    {
+        if (b & 0x80)                               // Q7 first
+            lcd_SR_port |= (1<<lcd_SR_data);
+        else
+            lcd_SR_port &= ~(1<<lcd_SR_data);
+        lcd_SR_port |= (1<<lcd_SR_clock);
+        lcd_SR_port &= ~(1<<lcd_SR_clock);
+        b <<= 1;
+    }
+    lcd_SR_port |= (1<<lcd_SR_latch);               // all outputs change together
+    lcd_SR_port &= ~(1<<lcd_SR_latch);
+
+    lcd_SR_ddr &= ~(1<<lcd_SR_data);                // back to input
+    lcd_SR_port |= (1<<lcd_SR_data);                // with pull-up
+}
+
+/*...........................................................................
+  Name:     lcd_sr_aux
+  Purpose:  set or clear a spare shift register output (LED, LCD power)
+  Entry:    (bit) output Q0..Q7, (on) new state
+  Exit:     no parameters
+  Notes:    blocks interrupts while shifting, the LCD routines run from the tick
+*/
+void lcd_sr_aux(uint8_t bit, uint8_t on)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (on)
+            lcd_sr |= (1<<bit);
+        else
+            lcd_sr &= ~(1<<bit);
+        lcd_sr_flush();
+    }
+}
+#endif
+
+/*============================== Frame buffer ==============================*/
+/*
+    main() does not write to the display directly once the tick is running.
+    It puts text in lcd_frame and lcd_service(), called from the tick
+    interrupt, copies whatever differs from lcd_shown to the module, one bus
+    write per call. An unchanged frame costs no bus traffic at all.
+
+    User glyphs are 8 rows in flash, lcd_glyph_define() only stores the
+    pointer and marks the glyph, lcd_service() uploads marked glyphs to
+    CGRAM before any text (9 writes per glyph). A glyph shows as character
+    lcd_GlyphChar + n, the CGRAM mirror, so it can be part of a string.
+*/
+static uint8_t lcd_frame[lcd_Lines][lcd_Columns];  // what we want on the display
+static uint8_t lcd_shown[lcd_Lines][lcd_Columns];  // what the display holds
+static uint8_t lcd_addr;                            // DDRAM address counter of the controller
+static volatile uint8_t lcd_dirty;                  // lcd_frame changed since the last full scan
+static const uint8_t *lcd_glyph[lcd_Glyphs];        // glyph patterns (flash)
+static volatile uint8_t lcd_glyph_dirty;            // bit n : glyph n to be uploaded
+static uint8_t lcd_glyph_row;                       // next row to upload, 0 = set the CGRAM address first
+static uint8_t lcd_glyph_n;                         // glyph being uploaded
+
+/*...........................................................................
+  Name:     lcd_frame_reset
+  Purpose:  mark the display as blank, as left by lcd_init
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    defined glyphs are uploaded again, CGRAM does not survive a power cycle
+*/
+void lcd_frame_reset(void)
+{
+    uint8_t line, col, n;
+
+    for (line = 0; line < lcd_Lines; line++)
+        for (col = 0; col < lcd_Columns; col++){
+            lcd_frame[line][col] = ' ';
+            lcd_shown[line][col] = ' ';
+        }
+    lcd_addr = lcd_LineOne;
+    lcd_glyph_row = 0;
+    lcd_glyph_n = lcd_Glyphs;
+    lcd_glyph_dirty = 0;
+    for (n = 0; n < lcd_Glyphs; n++)
+        if (lcd_glyph[n])
+            lcd_glyph_dirty |= (1<<n);
+    lcd_dirty = (lcd_glyph_dirty != 0);
+}
+
+/*...........................................................................
+  Name:     lcd_frame_write
+  Purpose:  put a string in the frame buffer
+  Entry:    (line) 0 or 1, (col) first column, (theString) text, clipped at the line end
+  Exit:     no parameters
+  Notes:    does not touch the LCD module, see lcd_service
+*/
+void lcd_frame_write(uint8_t line, uint8_t col, uint8_t theString[])
+{
+    while (*theString && col < lcd_Columns)
+        lcd_frame[line][col++] = *theString++;
+    lcd_dirty = 1;
+}
+
+/*...........................................................................
+  Name:     lcd_glyph_define
+  Purpose:  (re)define a user character
+  Entry:    (n) glyph 0..7, (rows) 8 bytes in flash, 5 bits each, top row first
+  Exit:     no parameters
+  Notes:    does not touch the LCD module, see lcd_service
+*/
+void lcd_glyph_define(uint8_t n, const uint8_t *rows)
+{
+    if (lcd_glyph[n] == rows)
+        return;
+    lcd_glyph[n] = rows;
+    if (n == lcd_glyph_n)
+        lcd_glyph_row = 0;                          // restart an upload in progress
+    lcd_glyph_dirty |= (1<<n);
+    lcd_dirty = 1;
+}
+
+/*...........................................................................
+  Name:     lcd_sleep
+  Purpose:  display off, backlight or LCD supply off where the board can switch it
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    the frame buffer is kept, lcd_service sends lcd_DisplayOff
+            on the shift register board the supply goes, controller and all,
+            its inputs are pulled low so it is not fed through them
+*/
+void lcd_sleep(void)
+{
+#ifdef lcd_SR
+    lcd_powered = 0;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        lcd_sr &= (1<<lcd_SR_LED);                  // data, RS, E and supply low
+        lcd_sr_flush();
+    }
+#else
+    lcd_onoff = lcd_DisplayOff;
+    lcd_dirty = 1;
+#ifdef lcd_BL_port
+    lcd_BL_port &= ~(1<<lcd_BL_bit);
+#endif
+#endif
+}
+
+/*...........................................................................
+  Name:     lcd_wake
+  Purpose:  undo lcd_sleep
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    a controller that stayed powered only needs lcd_DisplayOn, its
+            DDRAM and CGRAM are intact; after a supply cut this is lcd_init
+            (> 100 mS) and the frame buffer starts blank
+*/
+void lcd_wake(void)
+{
+    if (!lcd_powered)
+    {
+        lcd_init();
+        return;
+    }
+#ifdef lcd_BL_port
+    lcd_BL_port |= (1<<lcd_BL_bit);
+#endif
+    lcd_onoff = lcd_DisplayOn;
+    lcd_dirty = 1;
+}
+
+/*...........................................................................
+  Name:     lcd_service
+  Purpose:  move the display one step closer to the frame buffer
+  Entry:    no parameters
+  Exit:     1 when the display matches the frame buffer, 0 while work is left
+  Notes:    never waits on the busy flag, returns at once when the module is busy
+            a busy flag stuck for lcd_BF_ServiceCalls calls counts as a time-out
+            in timed mode the calls are far enough apart to skip the busy flag
+*/
+uint8_t lcd_service(void)
+{
+    uint8_t line, col, addr, c;
+
+    if (!lcd_dirty || !lcd_powered)
+        return 1;
+    if (!lcd_timed)
+    {
+        if (lcd_read_BF())                          // still busy with the last write
+        {
+            if (++lcd_busy_ticks >= lcd_BF_ServiceCalls)
+            {
+                lcd_busy_ticks = 0;
+                lcd_bf_timeout();
+            }
+            return 0;
+        }
+        lcd_busy_ticks = 0;
+    }
+
+    if (lcd_onoff)
+    {
+        lcd_write_instruction(lcd_onoff);
+        lcd_onoff = 0;
+        return 0;
+    }
+
+    if (lcd_glyph_dirty)
+    {
+        if (lcd_glyph_row == 0)
+        {
+            for (lcd_glyph_n = 0; !(lcd_glyph_dirty & (1<<lcd_glyph_n)); lcd_glyph_n++);
+            lcd_write_instruction(lcd_SetCGRAMAddr | (lcd_glyph_n << 3));
+            lcd_addr = 0xFF;                        // address counter now points into CGRAM
+            lcd_glyph_row = 1;
+            return 0;
+        }
+        lcd_write_character(pgm_read_byte(&lcd_glyph[lcd_glyph_n][lcd_glyph_row - 1]));
+        if (++lcd_glyph_row > 8)
+        {
+            lcd_glyph_dirty &= ~(1<<lcd_glyph_n);
+            lcd_glyph_row = 0;
+            lcd_glyph_n = lcd_Glyphs;
+        }
+        return 0;
+    }
+
+    for (line = 0; line < lcd_Lines; line++)
+        for (col = 0; col < lcd_Columns; col++)
+            if (lcd_frame[line][col] != lcd_shown[line][col])
+                goto found;
+    lcd_dirty = 0;
+    return 1;
+
+found:
+    addr = (line ? lcd_LineTwo : lcd_LineOne) + col;
+    if (addr != lcd_addr){
+        lcd_write_instruction(lcd_SetCursor | addr);
+        lcd_addr = addr;
+        return 0;
+    }
+    c = lcd_frame[line][col];
+    lcd_write_character(c);
+    lcd_shown[line][col] = c;
+    lcd_addr++;                                     // entry mode increments the address counter
+    return 0;
 }
  
 
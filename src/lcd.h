@@ -75,39 +75,16 @@
 #include <avr/io.h>
 #include <util/delay.h>
 
-// LCD interface (should agree with the diagram above)
-#define lcd_D7_port     PORTA                   // lcd D7 connection
-#define lcd_D7_bit      PORTA7
-#define lcd_D7_ddr      DDRA
-#define lcd_D7_pin      PINA                    // busy flag
-
-#define lcd_D6_port     PORTA                   // lcd D6 connection
-#define lcd_D6_bit      PORTA6
-#define lcd_D6_ddr      DDRA
-
-#define lcd_D5_port     PORTA                   // lcd D5 connection
-#define lcd_D5_bit      PORTA5
-#define lcd_D5_ddr      DDRA
-
-#define lcd_D4_port     PORTA                   // lcd D4 connection
-#define lcd_D4_bit      PORTA4
-#define lcd_D4_ddr      DDRA
-
-#define lcd_E_port      PORTA                   // lcd Enable pin
-#define lcd_E_bit       PORTA1
-#define lcd_E_ddr       DDRA
-
-#define lcd_RS_port     PORTA                   // lcd Register Select pin
-#define lcd_RS_bit      PORTA3
-#define lcd_RS_ddr      DDRA
-
-#define lcd_RW_port     PORTA                   // lcd Read/Write pin
-#define lcd_RW_bit      PORTA2
-#define lcd_RW_ddr      DDRA
+// LCD interface (should agree with the diagram above), per MCU in board.h
+#include "board.h"
 
 // LCD module information
 #define lcd_LineOne     0x00                    // start of line 1
 #define lcd_LineTwo     0x40                    // start of line 2
+#define lcd_Lines       2
+#define lcd_Columns     16
+#define lcd_Glyphs      8                       // user defined characters in CGRAM
+#define lcd_GlyphChar   8                       // character code of glyph 0 (0 would end a string)
 //#define   lcd_LineThree   0x14                  // start of line 3 (20x4)
 //#define   lcd_lineFour    0x54                  // start of line 4 (20x4)
 //#define   lcd_LineThree   0x10                  // start of line 3 (16x4)
@@ -123,6 +100,14 @@
 #define lcd_FunctionSet4bit 0b00101000          // 4-bit data, 2-line display, 5 x 7 font
 #define lcd_SetCursor       0b10000000          // set cursor position
 #define lcd_SetCursor2      0b10000001          // set cursor position
+#define lcd_SetCGRAMAddr    0b01000000          // set CGRAM address, (glyph << 3) | row
+
+// busy flag time-out
+#define lcd_BF_Poll_us      10                  // pause between two busy flag reads
+#define lcd_BF_Budget       300                 // reads before giving up, > 3 mS even for slow displays
+#define lcd_BF_MaxFails     3                   // time-outs in a row before switching to timed mode
+#define lcd_BF_ServiceCalls 5                   // lcd_service calls (tick = 1 mS) a busy flag may stay set
+#define lcd_Redetect        200                 // timed writes between two busy flag probes
 
 // Function Prototypes
 void lcd_write(uint8_t);
@@ -130,7 +115,25 @@ void lcd_write_instruction(uint8_t);
 void lcd_write_character(uint8_t);
 void lcd_write_string(uint8_t *);
 void lcd_init(void);
-void lcd_check_BF(void);
+void lcd_sleep(void);
+void lcd_wake(void);
+uint8_t lcd_check_BF(void);
+uint8_t lcd_read_BF(void);
+
+#ifdef lcd_SR
+extern uint8_t lcd_sr;                          // shift register image
+void lcd_sr_flush(void);
+void lcd_sr_aux(uint8_t, uint8_t);
+#endif
+
+extern uint16_t lcd_bf_timeouts;                // busy flag time-outs since reset
+extern uint8_t lcd_timed;                       // busy flag given up, using data sheet delays
+
+// frame buffer, refreshed in the background by lcd_service()
+void lcd_frame_reset(void);
+void lcd_frame_write(uint8_t, uint8_t, uint8_t *);
+void lcd_glyph_define(uint8_t, const uint8_t *);
+uint8_t lcd_service(void);
 
 /************************
  * Peter 20/02/2016
@@ -147,8 +150,9 @@ void lcd_check_BF(void);
 /***************************************************
     M A C R O S
 ***************************************************/
-// #define lcdWriteIntXY(x,y,val,fl) {\
-//  lcdGotoXY(x,y);\
-//  lcdWriteInt(val,fl);\
-// }
+/* #define lcdWriteIntXY(x,y,val,fl) {\
+    lcdGotoXY(x,y);\
+    lcdWriteInt(val,fl);\
+}
+*/
 /***************************************************/
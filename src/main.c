@@ -4,17 +4,44 @@
 
 #include <avr/io.h>
 #include <stdio.h>
-#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <util/delay.h>
+#include <avr/sleep.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
 
 #include "main.h"
 #include "lcd.h"
 //#include "LCD-AVR-4d.h"
 #include "srf04.h"
+#include "echo.h"
+#include "tick.h"
+#include "cache.h"
+#include "rtc.h"
+#include "event.h"
+#include "gauge.h"
 #include "adc.h"
+#include "button.h"
+#include "hist.h"
+#include "vcc.h"
+#include "health.h"
+#include "pace.h"
+#include "calib.h"
 
 uint8_t flipIt = 1;
-char buffer[4];
+char buffer[7];
+
+uint8_t page = PAGE_TANK;               // visible page
+uint8_t display = 1;                    // LCD on, off after DISPLAY_TIMEOUT
+int vol = 0;                            // liters, cached until live
+uint32_t stamp;                         // time of the cached value
+uint8_t live = 0;                       // vol is measured
+uint32_t bootTime = 0;                  // ms from reset to the first live reading
+uint16_t pressure;                      // raw ADC
+int16_t temperature;                    // degC
+uint8_t calEdit = 0;                    // entering a reference on the calibration page
+uint16_t calLiters;                     // reference being entered
 
 void flipLed(){
     if (flipIt == 1){
@@ -26,77 +53,455 @@ void flipLed(){
     }
 }
 
-void formatStr(int a){
-    if (a<10){
-        lcd_write_string("   ");
-        lcd_write_string(buffer);
-        return;
-    }
-    if (a<100){
-        lcd_write_string("  ");
-        lcd_write_string(buffer);
-        return;
-    }
-    if (a<1000){
-        lcd_write_string(" ");
-        lcd_write_string(buffer);
-        return;
-    }
-    if (a<5000){
-        lcd_write_string(buffer);
+// a counter in a 4 column field
+int upTo9999(uint16_t n){
+    return (n > 9999) ? 9999 : n;
+}
+
+// right align a in 4 columns followed by the unit, padded to width
+// and put at col, e.g. "  12 lit"
+void formatStr(uint8_t line, uint8_t col, uint8_t width, int a, char *unit){
+    uint8_t text[lcd_Columns+1];
+    uint8_t i = 0;
+    uint8_t n;
+
+    itoa (a,buffer,10);
+    for (n = strlen(buffer); n < 4; n++)
+        text[i++] = ' ';
+    for (n = 0; buffer[n]; n++)
+        text[i++] = buffer[n];
+    while (*unit && i < width)
+        text[i++] = *unit++;
+    while (i < width)
+        text[i++] = ' ';
+    text[i] = 0;
+    lcd_frame_write(line, col, text);
+}
+
+// time of day of s (seconds since 2000-01-01) followed by the unit, e.g. "   14:32 saved"
+void formatClock(uint8_t line, uint32_t s, char *unit){
+    uint8_t text[lcd_Columns+1];
+    uint8_t i = 0;
+    uint8_t h = (s / 3600) % 24;
+    uint8_t m = (s / 60) % 60;
+
+    text[i++] = ' ';
+    text[i++] = ' ';
+    text[i++] = ' ';
+    text[i++] = '0' + h / 10;
+    text[i++] = '0' + h % 10;
+    text[i++] = ':';
+    text[i++] = '0' + m / 10;
+    text[i++] = '0' + m % 10;
+    while (*unit && i < lcd_Columns)
+        text[i++] = *unit++;
+    while (i < lcd_Columns)
+        text[i++] = ' ';
+    text[i] = 0;
+    lcd_frame_write(line, 0, text);
+}
+
+// liters in the tank for a sensor distance d (cm)
+// lying cylinder, radius 60 cm, length 265 cm, mount and scale from calib.c
+int liters(uint16_t d){
+    return cal_volume(cal_depth(d));
+}
+
+// draw the visible page into the frame buffer, only the fields that
+// depend on what changed; hidden pages are never formatted
+void showPage(uint8_t what, uint32_t now){
+    if (!display)
         return;
+    switch (page){
+    case PAGE_TANK:
+        if (!live){
+            if (what == SHOW_ALL && stamp){
+                formatStr(0, 0, lcd_Columns, vol, " lit   old");
+                formatClock(1, stamp, " saved");
+            }
+            break;
+        }
+        if (what & SHOW_ADC)
+            formatStr(0, 8, 8, (int)pressure, " bar");
+        if (!(what & SHOW_READING))
+            break;
+        formatStr(0, 0, 8, vol, " lit");
+        // line two : a latched refill or loss, the boot time for a while, the gauge
+        if (event_alarm == EV_REFILL)
+            formatStr(1, 0, lcd_Columns, event_amount, " lit FILL!");
+        else if (event_alarm == EV_LOSS)
+            formatStr(1, 0, lcd_Columns, event_amount, " lit LOSS!");
+        else if (vcc_tier == VCC_CUTOFF)
+            formatStr(1, 0, lcd_Columns, vcc_mv, " mV battery");
+        else if (now - bootTime < BOOT_REPORT)
+            formatStr(1, 0, lcd_Columns, (int)bootTime, " ms boot");
+        else
+            gauge_draw(1, (uint32_t)vol * GAUGE_STEPS / TANK_LITERS);
+        break;
+
+    case PAGE_DISTANCE:
+        if (!(what & SHOW_READING))
+            break;
+        formatStr(0, 0, lcd_Columns, (int)echo_filtered, " cm  level");
+        formatStr(1, 0, lcd_Columns, echo_confidence, " %   echo");
+        break;
+
+    case PAGE_PRESSURE:
+        if (!(what & SHOW_ADC))
+            break;
+        formatStr(0, 0, lcd_Columns, (int)pressure, " bar");
+        lcd_frame_write(1, 0, (uint8_t *)"pressure raw    ");
+        break;
+
+    case PAGE_TEMP:
+        if (!(what & SHOW_ADC))
+            break;
+        formatStr(0, 0, lcd_Columns, temperature, " C");
+        lcd_frame_write(1, 0, (uint8_t *)"MCU temperature ");
+        break;
+
+    case PAGE_RATE:
+        if (!(what & SHOW_READING))
+            break;
+        formatStr(0, 0, lcd_Columns, event_rate, " l/day");
+        formatStr(1, 0, lcd_Columns, event_amount, " lit event");
+        break;
+
+    case PAGE_DAYS:
+        if (!(what & SHOW_READING))
+            break;
+        if (event_rate > 0)
+            formatStr(0, 0, lcd_Columns, vol / event_rate, " days left");
+        else
+            lcd_frame_write(0, 0, (uint8_t *)"   - days left  ");
+        formatStr(1, 0, lcd_Columns, TANK_LITERS - vol, " lit to fill");
+        break;
+
+    case PAGE_DIAG:
+        if (!(what & SHOW_READING))
+            break;
+        formatStr(0, 0, 8, upTo9999(health[HEALTH_TIMEOUT]), " tmo");
+        formatStr(0, 8, 8, upTo9999(health[HEALTH_REJECT]), " rej");
+        formatStr(1, 0, 8, upTo9999(health[HEALTH_LCD_BF]), " lcd");
+        formatStr(1, 8, 8, upTo9999(health[HEALTH_ADC_RANGE]), " adc");
+        break;
+
+    case PAGE_RESETS:
+        if (!(what & SHOW_READING))
+            break;
+        formatStr(0, 0, 8, upTo9999(health[HEALTH_RESET_POWER]), " pwr");
+        formatStr(0, 8, 8, upTo9999(health[HEALTH_RESET_EXT]), " ext");
+        formatStr(1, 0, 8, upTo9999(health[HEALTH_RESET_BROWN]), " bor");
+        formatStr(1, 8, 8, upTo9999(health[HEALTH_RESET_WDT]), " wdt");
+        break;
+
+    case PAGE_CALIB:
+        if (!(what & SHOW_READING))
+            break;
+        if (calEdit){
+            formatStr(0, 0, lcd_Columns, calLiters, " lit  ref?");
+            formatStr(1, 0, lcd_Columns, vol, " lit  now");
+        }else{
+            formatStr(0, 0, 8, cal_mount, " mm");
+            formatStr(0, 8, 8, (int)((uint32_t)cal_scale * 1000 / CAL_UNITY), " ppt");
+            formatStr(1, 0, lcd_Columns, cal_points, " ref points");
+        }
+        break;
+
+    case PAGE_HIST:
+        if (!(what & SHOW_READING))
+            break;
+        hist_draw(0);
+        formatStr(1, 0, 8, (int)hist.timeout, " tmo");
+        formatStr(1, 8, 8, (int)hist.zero, " zer");
+        break;
     }
 }
 
 /******************************* Main Program Code *************************/
+/*
+ * The loop is a pipeline, nothing in it waits:
+ *      - a ping goes out every vcc.ping ms, the ADC converts while its
+ *        echo is in flight (srf04 INT0/Timer0, ADC_vect)
+ *      - between two bursts the loop waits the pace (pace.c), nothing
+ *        while the level moves, up to minutes while it stands still
+ *      - a finished ping is classified, echo_burst_len accepted ones are
+ *        filtered into one reading and turned into liters
+ *      - lcd_service() writes the changed characters from the tick interrupt
+ *        while the next ping is under way
+ * The sample rate is set by the sensor, not by the sum of the stages.
+ *
+ * The button steps through the pages (PAGE_xx in main.h), a long press
+ * acknowledges a latched event (on the histogram page it saves the
+ * histogram to EEPROM and starts a new one, on the counter pages it
+ * clears the fault counters, on the calibration page see below). Only the
+ * visible page is formatted, and only when one of its values changed; a
+ * page switch redraws it at once and the frame buffer repaints the LCD
+ * within one frame (<= 34 ticks).
+ * DISPLAY_TIMEOUT after the last press the display goes off (lcd_sleep),
+ * measuring goes on but nothing is formatted; the next press only wakes
+ * it and redraws the page.
+ * The temperature page moves the ADC from the pressure input to the
+ * internal sensor, the first conversion after the switch is dropped.
+ *
+ * Every VCC_PERIOD s one conversion measures VCC instead (bandgap). The
+ * supply tier (vcc.c) sets the ping interval, the burst length and how
+ * often the page is redrawn, the pace comes on top of its ping interval.
+ * Below the cutoff each reading is followed by VCC_REPORT s of power-down,
+ * once the display went off; the button ends the nap.
+ *
+ * The tank page holds liters and pressure, line two the tank gauge. Every
+ * filtered reading also goes through the refill/loss detector, a finished
+ * event replaces the gauge and keeps the LED on.
+ *
+ * Calibration page : a long press starts a reference at the present
+ * volume, short presses add CAL_STEP liters (wrapping to 0), a long press
+ * takes the present distance as "the tank holds that many liters" and fits
+ * mount and scale again (calib.c). A reference left by the host in EEPROM
+ * is taken with the first reading. Either restarts the event detector.
+ *
+ * At power-on the last reading from EEPROM is shown, marked "old", until
+ * the first filtered burst replaces it.
+ */
 int main(void)
 {
     // srf04
     running = 0;
     up = 0;
     
-    float df;
-    int vol;
+    uint16_t cached;
+    uint8_t adcMux = ADC_PRESSURE;      // input of the conversion in flight
+    uint8_t adcSettle = 0;              // drop the next conversion, input just changed
+    uint8_t mux;
+    uint8_t press;
+    uint8_t class;
+    uint8_t stray;
+    uint8_t pending = 0;                // SHOW_xx waiting for the next display refresh
+    uint8_t vccDue = 1;                 // next conversion measures VCC
+    uint8_t napDue = 0;                 // below the cutoff, a reading was made
     
-    uint16_t adc_result;
+    uint32_t now;
+    uint32_t lastPing = 0;
+    uint32_t lastSample = 0;
+    uint32_t lastBlink = 0;
+    uint32_t lastPress = 0;
+    uint32_t lastShow = 0;
+    uint32_t lastReading = 0;
+    uint32_t gap = 0;                   // ms from lastReading to the next burst, 0 inside a burst
+    uint32_t lastVcc = 0;               // s
+    uint32_t napStart;                  // s
      
+    // reset cause, before rtc_init clears WDRF
+    health_init();
+    
+    // ms tick first, so boot time is counted from reset
+    tick_init();
+    sei();
+    
+    // watchdog clock, timestamps
+    rtc_init();
+    
     // LED
     LED_DDRB_OUTPUT_MODE();
     
     // initialize the LCD display for a 4-bit interface
     lcd_init();
     
+    // tank gauge and histogram glyphs, uploaded in the background
+    gauge_init();
+    hist_init();
+    
+    // last known level, before anything else
+    if (cache_load(&cached, &stamp)){
+        vol = cached;
+        showPage(SHOW_ALL, 0);
+    }else{
+        stamp = 0;
+    }
+    
+    button_init();
+    
     // initialize ultrasonic
     srf04_init();
     
-    // initialize adc
+    // mount offset and scale, host reference
+    cal_init();
+    
+    // initialize adc, full rate until VCC was measured
     adc_init();
+    vcc_init();
+    
+    set_sleep_mode(SLEEP_MODE_IDLE);
     
     while(1){
-        // display the first line of information
-        lcd_write_instruction(lcd_SetCursor | lcd_LineOne);
+        now = tick_now();
 
-        if (running == 0) { // launch only when next iteration can happen
-            _delay_ms(60);
+        // launch only when next iteration can happen
+        if (running == 0 && now - lastPing >= vcc.ping && now - lastReading >= gap) {
+            lastPing = now;
+            gap = 0;
             sonar(); // launch ultrasound measurement!
-            flipLed();
+            if (vccDue)
+                mux = ADC_BANDGAP;
+            else
+                mux = (page == PAGE_TEMP) ? ADC_TEMP : ADC_PRESSURE;
+            if (mux != adcMux){
+                adcMux = mux;
+                adcSettle = 1;
+            }
+            adc_start(mux);                 // converts while the echo is in flight
+        }
+        
+        // edges without a ping are spurious readings (0), they never overwrite distance
+        if (strayEdges){
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+                stray = strayEdges;
+                strayEdges = 0;
+            }
+            while (stray--){
+                hist_add(0);
+                echo_classify(0, 0);
+                health_count(HEALTH_REJECT);
+            }
+        }
+        
+        // only accepted echoes reach the volume stage, otherwise keep the last good one
+        if (sampleReady){
+            sampleReady = 0;
+            hist_add(echoTicks);
+            class = echo_classify(distance, now - lastSample);
+            if (class == ECHO_TIMEOUT)
+                health_count(HEALTH_TIMEOUT);
+            else if (class != ECHO_OK)
+                health_count(HEALTH_REJECT);
+            if (class == ECHO_OK && echo_burst(echo_level)){
+                if (cal_pending != CAL_NONE){
+                    cal_add(echo_filtered, cal_pending);
+                    cal_pending = CAL_NONE;
+                    event_reset();
+                }
+                vol = liters(echo_filtered);
+                cache_save(vol, rtc_now());
+                event_update(vol, rtc_now());
+                if (!live){
+                    live = 1;
+                    bootTime = now;
+                    cache_boot_time(bootTime);
+                }
+                pending |= SHOW_READING;
+                lastReading = now;
+                gap = pace_update(echo_filtered, now);
+                if (vcc_tier == VCC_CUTOFF)
+                    napDue = 1;
+            }
+            lastSample = now;
+        }
+        
+        if (adc_ready){
+            adc_ready = 0;
+            if (adcSettle){
+                adcSettle = 0;
+            }else{
+                if (adcMux == ADC_BANDGAP){
+                    vccDue = 0;
+                    lastVcc = rtc_now();
+                    if (vcc_update(adc_value, lastVcc))
+                        echo_burst_len = vcc.burst;
+                }else{
+                    if (adcMux == ADC_TEMP)
+                        temperature = (int16_t)adc_value - ADC_TEMP_OFFSET;
+                    else{
+                        pressure = adc_value;
+                        if (pressure == 0 || pressure >= 1023)  // open or shorted sensor
+                            health_count(HEALTH_ADC_RANGE);
+                    }
+                    pending |= SHOW_ADC;
+                }
+            }
+        }
+        if (rtc_now() - lastVcc >= VCC_PERIOD)
+            vccDue = 1;
+        
+        if (pending && now - lastShow >= vcc.refresh){
+            showPage(pending, now);
+            pending = 0;
+            lastShow = now;
+        }
+        
+        press = button_poll(now);
+        if (press != BUTTON_NONE){
+            lastPress = now;
+            gap = 0;                        // somebody is looking, fresh values now
+            if (!display){
+                display = 1;
+                lcd_wake();
+                showPage(SHOW_ALL, now);
+                press = BUTTON_NONE;        // a press on a dark display only wakes it
+            }
+        }else if (display && now - lastPress >= DISPLAY_TIMEOUT){
+            display = 0;
+            lcd_sleep();
+        }
+        switch (press){
+        case BUTTON_SHORT:
+            if (calEdit)
+                calLiters = (calLiters + CAL_STEP > TANK_LITERS) ? 0 : calLiters + CAL_STEP;
+            else
+                page = (page + 1) % PAGES;
+            showPage(SHOW_ALL, now);
+            break;
+        case BUTTON_LONG:
+            if (page == PAGE_CALIB){
+                if (calEdit){
+                    calEdit = 0;
+                    cal_add(echo_filtered, calLiters);
+                    event_reset();
+                }else if (live){
+                    calEdit = 1;
+                    calLiters = (vol + CAL_STEP / 2) / CAL_STEP * CAL_STEP;
+                }
+            }else if (page == PAGE_HIST){
+                hist_save();
+                hist_clear();
+            }else if (page == PAGE_DIAG || page == PAGE_RESETS){
+                health_clear();
+            }else{
+                event_ack();
+            }
+            showPage(SHOW_ALL, now);
+            break;
+        }
+        
+        rtc_service();
+        health_service(rtc_now());
+        
+        if (now - lastBlink >= HEARTBEAT){
+            lastBlink = now;
+            if (event_alarm)
+                LED_HIGH();                 // steady on while an event is latched
+            else
+                flipLed();
+            if (page == PAGE_DIAG || page == PAGE_RESETS || page == PAGE_HIST)
+                pending |= SHOW_READING;    // counters also move on rejected echoes
+        }
+        
+        // below the cutoff : the reading is out, power-down until the next one
+        if (napDue && !display && running == 0){
+            napDue = 0;
+            napStart = rtc_now();
+            health_save();
+            ADCSRA &= ~(1 << ADEN);
+            set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+            while (rtc_now() - napStart < VCC_REPORT && !button_down()){
+                rtc_sleep();                // the tick stops, keep it out of the calibration
+                sleep_mode();               // watchdog (1 s) or button
+            }
+            set_sleep_mode(SLEEP_MODE_IDLE);
+            ADCSRA |= (1 << ADEN);
+            vccDue = 1;
         }
-//         distance = rand() % 5000;
-//         flipLed();
         
-         df=(float)134-distance;
-         vol = (265*((pow(60,2)*acos((60-df)/60))-(60-df)*sqrt((2*60*df)-pow(df,2))))/1000;
-         itoa ((int)vol,buffer,10);
-         formatStr((int)vol);lcd_write_string(" lit");
-         lcd_write_instruction(lcd_SetCursor | lcd_LineTwo);
-         //itoa ((int)distance,buffer,10);
-         //formatStr((int)distance);lcd_write_string(" mm");
-         //formatStr((int)timerCounter);lcd_write_string(" cnt");
-         adc_result = adc_read(0);          // PA0
-         itoa ((int)adc_result,buffer,10);
-         formatStr((int)adc_result);lcd_write_string(" bar");
-         
-         _delay_ms(1000);                 
+        sleep_mode();                       // idle until the next tick or sensor interrupt
     }
     return 0;
 }
@@ -1,11 +1,26 @@
-// LED
-#define LED_NUMMER PB0
-#define LED_DDRB DDRB
-#define LED_PORT PORTB
+// LED, pin per MCU
+#include "board.h"
 
-#define LED_DDRB_OUTPUT_MODE() LED_DDRB |= (1<<LED_NUMMER)    // set as output
+#define HEARTBEAT 500       // ms, LED toggle
+#define BOOT_REPORT 3000    // ms the boot-to-first-reading time stays on line two
+#define DISPLAY_TIMEOUT 120000UL    // ms without a button press before the display goes off
 
-#define LED_HIGH() LED_PORT |= (1<<LED_NUMMER)
-#define LED_LOW() LED_PORT &= ~(1<<LED_NUMMER)
+// display pages, the button steps through them
+#define PAGE_TANK       0   // liters, pressure, gauge
+#define PAGE_DISTANCE   1   // filtered distance, echo confidence
+#define PAGE_PRESSURE   2
+#define PAGE_TEMP       3   // MCU internal sensor
+#define PAGE_RATE       4   // consumption, last event
+#define PAGE_DAYS       5   // days to empty, liters to fill
+#define PAGE_DIAG       6   // fault counters (health.c)
+#define PAGE_RESETS     7   // resets by cause
+#define PAGE_HIST       8   // raw echo time histogram
+#define PAGE_CALIB      9   // mount offset and scale, reference entry
+#define PAGES           10
+
+// what changed since a page was drawn
+#define SHOW_READING    1   // filtered reading
+#define SHOW_ADC        2   // conversion
+#define SHOW_ALL        3   // page switch
 
 int main(void);
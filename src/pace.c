@@ -0,0 +1,89 @@
+#include <avr/io.h>
+
+#include "pace.h"
+
+/* ---------------------------------------------------------------------------
+ *
+ * Every filtered reading d (cm) updates
+ *      mean    EWMA 1/4 of d, x16
+ *      var     EWMA 1/4 of (d - mean)^2, cm^2 x16
+ *      anchor  last level that counted as a move, and its time
+ *
+ * rate of change = |d - anchor| / time since the anchor, only once d left
+ * the anchor by PACE_MOVE, so one cm of jitter never looks like a refill.
+ * An anchor that did not move for PACE_WINDOW ms is set to the mean, the
+ * rate is always taken over a recent stretch of time.
+ *
+ *  rate >= PACE_FAST_RATE or var >= PACE_VAR_FAST   -> PACE_MIN at once
+ *  rate >= PACE_SLOW_RATE or var >= PACE_VAR_SLOW   -> hold
+ *  otherwise, every PACE_CALM ms                    -> interval x2, up to PACE_MAX
+ *
+ * Speeding up is immediate, slowing down takes steps: that is the
+ * hysteresis. A refill seen after a PACE_MAX gap has moved tens of cm and
+ * switches to full speed with the next reading.
+ *
+ * ---------------------------------------------------------------------------*/
+
+uint32_t pace_interval = PACE_MIN;
+
+static uint8_t started;
+static uint16_t mean;                   // cm x16
+static uint16_t var;                    // cm^2 x16
+static uint16_t anchor;                 // cm
+static uint32_t anchorTime;             // ms
+static uint32_t calmSince;              // ms
+
+/*
+ * d   : filtered reading (cm)
+ * now : ms
+ * returns the new pace_interval
+ */
+uint32_t pace_update(uint16_t d, uint32_t now){
+    int16_t dev;
+    int32_t sq;
+    uint16_t move;
+    uint32_t rate = 0;                  // cm/h
+
+    if (!started){
+        started = 1;
+        mean = d * 16;
+        anchor = d;
+        anchorTime = now;
+        calmSince = now;
+        return pace_interval;
+    }
+
+    dev = (int16_t)(d * 16) - (int16_t)mean;
+    mean += dev / 4;
+    sq = (int32_t)dev * dev / 16;       // (cm x16)^2 -> cm^2 x16
+    if (sq > 0xFFFF)
+        sq = 0xFFFF;
+    var += (sq - var) / 4;
+
+    move = (d > anchor) ? d - anchor : anchor - d;
+    if (move >= PACE_MOVE){
+        if (now != anchorTime)
+            rate = (uint32_t)move * 3600000UL / (now - anchorTime);
+        anchor = d;
+        anchorTime = now;
+    }else if (now - anchorTime >= PACE_WINDOW){
+        anchor = (mean + 8) / 16;       // burner drift never adds up to a move
+        anchorTime = now;
+    }
+
+    if (rate >= PACE_FAST_RATE || var >= PACE_VAR_FAST){
+        pace_interval = PACE_MIN;
+        calmSince = now;
+    }else if (rate >= PACE_SLOW_RATE || var >= PACE_VAR_SLOW){
+        calmSince = now;
+    }else if (now - calmSince >= PACE_CALM){
+        calmSince = now;
+        if (pace_interval < PACE_STEP)
+            pace_interval = PACE_STEP;
+        else if (pace_interval < PACE_MAX / 2)
+            pace_interval *= 2;
+        else
+            pace_interval = PACE_MAX;
+    }
+    return pace_interval;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+/* ---------------------------------------------------------------------------
+ * change-driven reading rate : back to back pings while the level moves,
+ * minutes apart while it stands still
+ * ---------------------------------------------------------------------------*/
+
+#define PACE_MIN            0           // ms between two bursts at full speed, pings back to back
+#define PACE_STEP           1000        // ms, first step down from full speed
+#define PACE_MAX            300000UL    // ms between two bursts on a standing level
+#define PACE_CALM           60000UL     // ms without movement before each slow-down step
+#define PACE_WINDOW         600000UL    // ms, longest time a rate of change is taken over
+#define PACE_MOVE           2           // cm from the anchor that count as a real move (> ECHO_NOISE jitter)
+#define PACE_FAST_RATE      30          // cm/h, at or above : full speed at once (refill ~1800, burner < 1)
+#define PACE_SLOW_RATE      10          // cm/h, between the two rates : hold the present pace
+#define PACE_VAR_FAST       64          // cm^2 x16, erratic readings (foam, splashing) : full speed
+#define PACE_VAR_SLOW       16          // cm^2 x16, slow down only below this
+
+extern uint32_t pace_interval;          // ms from one reading to the next burst
+
+uint32_t pace_update(uint16_t d, uint32_t now);
@@ -0,0 +1,25 @@
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "ring.h"
+
+/* ---------------------------------------------------------------------------
+ *
+ * A ring is an EEMEM array of count records plus one byte, next, the slot
+ * the following record goes to. The newest record is the one before next,
+ * the oldest the one at next once the ring went round. An erased EEPROM
+ * (next = 0xFF) starts at slot 0.
+ *
+ * Nothing on the MCU reads the rings back, they are for the programmer
+ * (avrdude -U eeprom:r:...), avr-nm main gives each ee_ address.
+ *
+ * ---------------------------------------------------------------------------*/
+
+void ring_put(void *log, uint8_t *next, const void *record, uint8_t size, uint8_t count){
+    uint8_t n = eeprom_read_byte(next);
+
+    if (n >= count)
+        n = 0;
+    eeprom_update_block(record, (uint8_t *)log + n * size, size);
+    eeprom_update_byte(next, (n + 1) % count);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+/* ---------------------------------------------------------------------------
+ * record rings in EEPROM, shared by the event, VCC and calibration logs
+ * ---------------------------------------------------------------------------*/
+
+void ring_put(void *log, uint8_t *next, const void *record, uint8_t size, uint8_t count);
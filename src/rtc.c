@@ -0,0 +1,136 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+#include <util/atomic.h>
+
+#include "rtc.h"
+#include "tick.h"
+#include "board.h"
+
+/* ---------------------------------------------------------------------------
+ *
+ * The watchdog runs from its own 128kHz oscillator, also in power-down, and
+ * is used in interrupt mode (no reset) with a ~1 s period. That oscillator
+ * is only good to some 10% and drifts with temperature and VCC, so every
+ * watchdog interrupt adds rtc_period us instead of a flat second.
+ *
+ * calibration :
+ *      while the CPU is awake the ms tick (main clock) runs alongside, the
+ *      ticks counted over RTC_CAL_PERIODS watchdog periods give the real
+ *      period. rtc_sleep() must be called before power-down, the tick stops
+ *      there and that window is not used.
+ *
+ * persistence :
+ *      epoch and rtc_period are saved every RTC_SAVE_PERIOD s and restored
+ *      at power-on. Time spent without power is lost, the clock continues
+ *      from the last save.
+ *
+ * host reference :
+ *      a host can set the clock by writing the epoch into ee_setEpoch with
+ *      the programmer (avrdude -U eeprom:w:...), it is taken at the next
+ *      power-on and erased.
+ *
+ * ---------------------------------------------------------------------------*/
+
+static uint32_t EEMEM ee_epoch = RTC_UNSET;
+static uint32_t EEMEM ee_period = RTC_UNSET;
+static uint32_t EEMEM ee_setEpoch = RTC_UNSET;
+
+volatile uint32_t rtc_period = RTC_NOMINAL;
+static volatile uint32_t seconds;
+static volatile uint32_t fraction;      // us, not yet a full second
+static volatile uint8_t calValid;       // lastTick is usable
+static uint8_t calCount;
+static uint32_t calTicks;
+static uint32_t lastTick;
+static uint32_t lastSave;
+
+void rtc_init(void){
+    uint32_t e;
+
+    e = eeprom_read_dword(&ee_period);
+    if (e != RTC_UNSET && e > RTC_NOMINAL - RTC_CAL_LIMIT && e < RTC_NOMINAL + RTC_CAL_LIMIT)
+        rtc_period = e;
+
+    e = eeprom_read_dword(&ee_setEpoch);
+    if (e != RTC_UNSET){
+        eeprom_update_dword(&ee_setEpoch, RTC_UNSET);
+    }else{
+        e = eeprom_read_dword(&ee_epoch);
+        if (e == RTC_UNSET)
+            e = 0;
+    }
+    seconds = e;
+    lastSave = e;
+
+    // watchdog in interrupt mode, 1 s
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        wdt_reset();
+        MCUSR &= ~(1 << WDRF);                          // WDRF would force WDE on
+        WDT_CONTROL |= (1 << WDCE) | (1 << WDE);        // timed sequence, 4 cycles
+        WDT_CONTROL = (1 << WDIE) | (1 << WDP2) | (1 << WDP1);
+    }
+}
+
+uint32_t rtc_now(void){
+    uint32_t s;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        s = seconds;
+    }
+    return s;
+}
+
+void rtc_set(uint32_t epoch){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        seconds = epoch;
+        fraction = 0;
+    }
+    lastSave = epoch;
+    eeprom_update_dword(&ee_epoch, epoch);
+}
+
+// the ms tick stops in power-down, drop the running calibration window
+void rtc_sleep(void){
+    calValid = 0;
+}
+
+// call from the main loop, saves the clock now and then
+void rtc_service(void){
+    uint32_t s = rtc_now();
+
+    if (s - lastSave < RTC_SAVE_PERIOD)
+        return;
+    lastSave = s;
+    eeprom_update_dword(&ee_epoch, s);
+    eeprom_update_dword(&ee_period, rtc_period);
+}
+
+ISR(WDT_vect)
+{
+    uint32_t t;
+    uint32_t measured;
+
+    fraction += rtc_period;
+    while (fraction >= 1000000UL){
+        fraction -= 1000000UL;
+        seconds++;
+    }
+
+    t = tick_now();
+    if (calValid){
+        calTicks += t - lastTick;
+        if (++calCount >= RTC_CAL_PERIODS){
+            measured = (calTicks * (1000000UL / TICK_HZ)) / RTC_CAL_PERIODS;
+            if (measured > RTC_NOMINAL - RTC_CAL_LIMIT && measured < RTC_NOMINAL + RTC_CAL_LIMIT)
+                rtc_period = (rtc_period * 3 + measured) / 4;
+            calCount = 0;
+            calTicks = 0;
+        }
+    }else{
+        calCount = 0;
+        calTicks = 0;
+    }
+    lastTick = t;
+    calValid = 1;
+}
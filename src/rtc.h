@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+/* ---------------------------------------------------------------------------
+ * software real-time clock on the watchdog interrupt, keeps running in
+ * power-down sleep
+ *
+ * time is in seconds since 2000-01-01 00:00, like time_t in avr-libc
+ * ---------------------------------------------------------------------------*/
+
+#define RTC_NOMINAL         1000000UL   // us, watchdog period with WDP2|WDP1
+#define RTC_CAL_PERIODS     16          // watchdog periods per calibration measurement
+#define RTC_CAL_LIMIT       250000UL    // us, measurements further off than this are dropped
+#define RTC_SAVE_PERIOD     3600        // s between two EEPROM saves
+#define RTC_UNSET           0xFFFFFFFF  // erased EEPROM
+
+void rtc_init(void);
+uint32_t rtc_now(void);
+void rtc_set(uint32_t epoch);
+void rtc_sleep(void);
+void rtc_service(void);
+
+extern volatile uint32_t rtc_period;    // us, calibrated length of one watchdog period
@@ -32,9 +32,44 @@
  *      379.999/65.536 = 5,798          379.999/256 = 1484.37109375
  *      379.999-(65.536*5) = 52.319     379.999-(256*1484) = 95
  *      ==> 5 overflows & 52.319 tiks
+ *
+ * Per MCU (board.h), no run time choice:
+ *      SONAR_ICP   ATmega328P, Timer1 input capture, the edges are time
+ *                  stamped in hardware, interrupt latency does not matter
+ *      SONAR_T16   ATtiny84, INT0 reads the free running 16-bit Timer1
+ *      SONAR_T8    ATtiny85, INT0 + 8-bit Timer0, overflows counted in
+ *                  timerCounter
+ * The 16-bit timers run at SONAR_PRESCALE so that 50 ms fit in one lap,
+ * the time-out is a compare match armed at the trigger.
+ *
+ *      distance (cm) = ticks * 0.017 cm/us = ticks * 17 / SONAR_TICKS_PER_MS
  * 
  * ---------------------------------------------------------------------------*/
 
+volatile uint32_t running;
+volatile unsigned char up;
+volatile uint32_t distance;
+volatile uint32_t echoTicks;
+volatile uint32_t timerCounter;
+volatile unsigned char sampleReady;
+volatile uint8_t strayEdges;
+
+#if defined(SONAR_ICP) || defined(SONAR_T16)
+static uint16_t echoStart;              // timer value at the rising edge
+#endif
+
+
+static uint32_t toCm(uint32_t ticks){
+    return (ticks * 17) / SONAR_TICKS_PER_MS;
+}
+
+static void done(uint32_t ticks){
+    echoTicks = ticks;
+    distance = (ticks == SONAR_NO_ECHO) ? 999 : toCm(ticks);
+    up = 0;
+    running = 0;
+    sampleReady = 1;
+}
 
 void srf04_init(){
     // ------------------- ultrasonic init code --------------------
@@ -45,70 +80,133 @@ void srf04_init(){
     
     cli(); //disable global interrupts
     
-    // interrupt 0 initialization
-    EICRA |= (0 << ISC01) | (1 << ISC00);   // enable interrupt on any(rising/droping) edge
-    EIMSK |= (1 << INT0);                   // Turns on INT0
-    OCR1A =  1484;                   //sets the desired count to got time-out to 38mS if prescaler = 0
-    // timer 0 initialization
-    TCCR0B |= (1 << CS00);                  // set up timer with no prescaling
+#if defined(SONAR_ICP)
+    // timer 1 free running, capture on the rising edge first, noise canceler on
+    TCCR1A = 0;
+    TCCR1B = (1 << ICNC1) | (1 << ICES1) | SONAR_CS;
+#elif defined(SONAR_T16)
+    // interrupt 0 on any(rising/droping) edge, timer 1 free running
+    SONAR_INT0_INIT();
+    TCCR1A = 0;
+    TCCR1B = SONAR_CS;
+#else
+    // interrupt 0 on any(rising/droping) edge, timer 0 overflow counting
+    SONAR_INT0_INIT();
+    TCCR0B = SONAR_CS0;
     TCNT0 = 0;                              // initialize counter
-    TIMSK0 |= (1 << TOIE0);                 // enable timer interrupt
+    TIMSK |= (1 << TOIE0);                  // enable timer interrupt
+#endif
     
     sei();                                  // Enable Global Interrupt
 }
 
-//Timer0 overflow detect
-/*
- * f = speed of crystal in Hz.
- * 
- * T = 1 / f = The time of one clock-pulse (Sec).               : 1e-07
- * N = 0.038 / T = Number of clock-pulses in 38ms seconds.      : 380.000
- * no prescaler value. use of 16bit counter
- * n = number of timer overflows int(N / 65536)
- * r = rest = N - (65536 * n)
- * 
-*/
-ISR(TIM0_OVF_vect)
+#if defined(SONAR_ICP)
+
+ISR(TIMER1_CAPT_vect)
 {
-    if (up){
+    if (!up){                           // rising edge, now wait for the falling one
+        echoStart = ICR1;
+        up = 1;
+        TCCR1B &= ~(1 << ICES1);
+        TIFR1 = (1 << ICF1);            // edge change may set the flag
+    }else{
+        done((uint16_t)(ICR1 - echoStart));
+        TIMSK1 &= ~((1 << ICIE1) | (1 << OCIE1B));
+    }
+}
+
+ISR(SONAR_TIMEOUT_vect)
+{
+    TIMSK1 &= ~((1 << ICIE1) | (1 << OCIE1B));
+    done(SONAR_NO_ECHO);
+}
+
+#elif defined(SONAR_T16)
+
+// interrupt for INT0 pin, to detect high/low voltage changes
+SIGNAL(INT0_vect){
+    uint16_t t = TCNT1;
+
+    if(running){ //accept interrupts only when sonar was started
+        if (SONAR_ECHO_HIGH()) { // voltage rise, start time measurement
+            echoStart = t;
+            up = 1;
+        } else if (up) { // voltage drop, stop time measurement
+            TIMSK1 &= ~(1 << OCIE1B);
+            done((uint16_t)(t - echoStart));
+        }
+    }else if (strayEdges != 0xFF){  // no ping out, keep distance, main() counts it
+        strayEdges++;
+    }
+}
+
+ISR(SONAR_TIMEOUT_vect)
+{
+    TIMSK1 &= ~(1 << OCIE1B);
+    done(SONAR_NO_ECHO);
+}
+
+#else
+
+//Timer0 overflow detect, also the time-out
+ISR(SONAR_OVF_vect)
+{
+    if (running){
         timerCounter++;     // count the timer overflow's
-        if (timerCounter >= 240){
-            distance=999;
-            TCCR0B |= (0 << CS00);                            //Stop Timer
-            running = 0;
+        if (timerCounter >= SONAR_TIMEOUT / 256){
+            timerCounter=0;
+            done(SONAR_NO_ECHO);
         }
     }
 }
 
 // interrupt for INT0 pin, to detect high/low voltage changes
-// We assume, that high voltage rise comes before low drop and not vice versa
-// Check change in the level at the PD3 for falling/rising edge
 SIGNAL(INT0_vect){
     if(running){ //accept interrupts only when sonar was started
-        if (up == 0 ) { // voltage rise, start time measurement
+        if (SONAR_ECHO_HIGH()) { // voltage rise, start time measurement
             up = 1;
-            //Setup Timer0
             TCNT0 = 0;                  // initialize counter
-        } else { // voltage drop, stop time measurement
-            up = 0;
-            /* use this for measurement of < 1,40m we use nbrCnt = 2 */
-            distance=(((timerCounter*256)+TCNT0)*0.017);        //0010200612
+            timerCounter = 0;
+        } else if (up) { // voltage drop, stop time measurement
+            done((timerCounter*256)+TCNT0);
             timerCounter=0;
-            TCCR0B |= (0 << CS00);                            //Stop Timer
-            running = 0;
         }
-    }else {
-        distance=0;
-        TCCR0B |= (0 << CS00);                            //Stop Timer
-        running = 0;
+    }else if (strayEdges != 0xFF){  // no ping out, keep distance, main() counts it
+        strayEdges++;
     }
 }
 
+#endif
+
 void sonar() {
+#ifdef SONAR_ONE_PIN
+    SONAR_INT0_OFF();                   // don't see our own trigger
+    SONAR_TRIGGER_OUTPUT_MODE();
+#endif
     SONAR_TRIGGER_LOW();
     _delay_us(2);
     SONAR_TRIGGER_HIGH();
     _delay_us(10);
     SONAR_TRIGGER_LOW();
+#ifdef SONAR_ONE_PIN
+    SONAR_ECHO_INPUT_MODE();
+    SONAR_ECHO_PULL_UP();
+    SONAR_INT0_ON();
+#endif
+
+    up = 0;
+#if defined(SONAR_ICP)
+    TCCR1B |= (1 << ICES1);
+    OCR1B = TCNT1 + SONAR_TIMEOUT;
+    TIFR1 = (1 << ICF1) | (1 << OCF1B);
+    TIMSK1 |= (1 << ICIE1) | (1 << OCIE1B);
+#elif defined(SONAR_T16)
+    OCR1B = TCNT1 + SONAR_TIMEOUT;
+    TIFR1 = (1 << OCF1B);
+    TIMSK1 |= (1 << OCIE1B);
+#else
+    TCNT0 = 0;
+    timerCounter = 0;
+#endif
     running = 1;  // sonar launched
 }
@@ -1,28 +1,27 @@
-#define EICRA MCUCR         // names seems to be different ....
-#define EIMSK GIMSK
-
+#include "board.h"          // pins, timer and INT0 register names per MCU
 
 //  SONAR_TRIGGER OUTPUT
-#define SONAR_TRIGGER_DDR DDRB
-#define SONAR_TRIGGER_PORT PORTB
-#define SONAR_TRIGGER_PIN PB1  //PB1 pin 3
-
 #define SONAR_TRIGGER_OUTPUT_MODE() SONAR_TRIGGER_DDR |= (1<<SONAR_TRIGGER_PIN)         // set as output
 
 #define SONAR_TRIGGER_LOW() SONAR_TRIGGER_PORT &= ~(1<<SONAR_TRIGGER_PIN)
 #define SONAR_TRIGGER_HIGH() SONAR_TRIGGER_PORT |= (1<<SONAR_TRIGGER_PIN)
 
 // SONAR ECHO INPUT
-#define SONAR_ECHO_DDR DDRB
-#define SONAR_ECHO_PORT PORTB
-#define SONAR_ECHO_PIN PB2      // PB2 pin 5
 #define SONAR_ECHO_INPUT_MODE() SONAR_ECHO_DDR &= ~(1 << SONAR_ECHO_PIN)                 // set as input
 #define SONAR_ECHO_PULL_UP() SONAR_ECHO_PORT |= (1 << SONAR_ECHO_PIN)                    // pull-up
+#define SONAR_ECHO_HIGH() (SONAR_ECHO_IN & (1 << SONAR_ECHO_PIN))
+
+#define SONAR_TIMEOUT_MS 50             // from trigger, the sensor gives up after 38 ms
+#define SONAR_TIMEOUT (SONAR_TIMEOUT_MS * SONAR_TICKS_PER_MS)
+#define SONAR_NO_ECHO 0xFFFFFFFFUL      // echoTicks on a time-out
 
-volatile uint32_t running;
-volatile unsigned char up;
-volatile uint32_t distance;
-volatile uint32_t timerCounter;
+extern volatile uint32_t running;
+extern volatile unsigned char up;
+extern volatile uint32_t distance;
+extern volatile uint32_t echoTicks;            // raw echo length in timer ticks, before the cm conversion
+extern volatile uint32_t timerCounter;
+extern volatile unsigned char sampleReady;     // a ping finished, distance holds its result
+extern volatile uint8_t strayEdges;            // echo edges while no ping was running, stops at 0xFF
 
 void srf04_init();
 void sonar();
@@ -0,0 +1,67 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "tick.h"
+#include "board.h"
+#include "lcd.h"
+
+/* ---------------------------------------------------------------------------
+ *
+ * system tick : 8-bit timer in CTC mode, TICK_INIT/TICK_vect in board.h
+ *      Timer0 on ATtiny84 and ATmega328P, Timer1 on ATtiny85
+ *      TICK_OCR = F_CPU / TICK_PRESCALE / 1000 - 1
+ *               = 124 @ 1MHz and 8MHz, 249 @ 16MHz, 61 @ 4MHz (62.5 counts/ms)
+ *
+ * When the timer counts per ms are not whole (TICK_REM, 4MHz) the period
+ * alternates between TICK_OCR + 1 and TICK_OCR + 2 counts, Bresenham
+ * style, so the ms clock and the RTC calibrated against it stay exact
+ * on average.
+ *
+ * Besides counting ms the tick drives the LCD refresh (lcd_service), one bus
+ * write per tick, so main() never waits on the display. The ISR counts with
+ * interrupts off, so no other ISR (WDT reading tick_now for the RTC) can
+ * see ticks half incremented, then re-enables them before the LCD write:
+ * the INT0 echo edges and Timer0 must not be delayed by LCD traffic or the
+ * distance would be off.
+ *
+ * ---------------------------------------------------------------------------*/
+
+static volatile uint32_t ticks;
+static volatile uint8_t inTick;
+
+void tick_init(void){
+    ticks = 0;
+    TICK_INIT();
+}
+
+uint32_t tick_now(void){
+    uint32_t t;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        t = ticks;
+    }
+    return t;
+}
+
+ISR(TICK_vect)
+{
+#if TICK_REM
+    static uint16_t rem;
+
+    rem += TICK_REM;                    // the period that just started
+    if (rem >= 1000){
+        rem -= 1000;
+        TICK_TOP(TICK_OCR + 1);
+    }else{
+        TICK_TOP(TICK_OCR);
+    }
+#endif
+    ticks++;
+    if (inTick)                 // previous LCD write still going
+        return;
+    inTick = 1;
+    sei();                      // the rest may be interrupted
+    lcd_service();
+    cli();
+    inTick = 0;
+}
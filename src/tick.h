@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+#define TICK_HZ         1000            // one tick per ms, see TICK_OCR in board.h
+
+void tick_init(void);
+uint32_t tick_now(void);
@@ -0,0 +1,78 @@
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+
+#include "vcc.h"
+#include "ring.h"
+
+/* ---------------------------------------------------------------------------
+ *
+ * With VCC as ADC reference, converting the 1.1 V bandgap gives
+ *      VCC (mV) = VCC_BANDGAP * 1024 / ADC
+ * no divider and no pin needed. The bandgap needs a conversion to settle
+ * after the mux switched to it, main() drops the first one.
+ *
+ * tiers :
+ *      the first tier whose floor VCC reaches applies, a better tier than
+ *      the present one needs VCC_HYST more so a sagging battery does not
+ *      flip back and forth. Every change goes into a ring of VCC_LOG
+ *      records in EEPROM (ring.c, ee_log/ee_next, read out with the
+ *      programmer), the dates tell how fast the battery goes.
+ *
+ * ---------------------------------------------------------------------------*/
+
+static const struct vcc_tier tiers[VCC_TIERS] PROGMEM = {
+    // floor    ping    burst   refresh
+    { 4200,     60,     5,      0    },     // adapter or fresh pack
+    { 3800,     250,    5,      1000 },
+    { 3400,     1000,   3,      5000 },
+    { 0,        60,     3,      0    },     // cutoff, one reading per VCC_REPORT
+};
+
+static struct vcc_record EEMEM ee_log[VCC_LOG];
+static uint8_t EEMEM ee_next;           // next record to write
+
+uint16_t vcc_mv;
+uint8_t vcc_tier;
+struct vcc_tier vcc;
+
+static void load(uint8_t n){
+    vcc_tier = n;
+    memcpy_P(&vcc, &tiers[n], sizeof(vcc));
+}
+
+static void record(uint32_t t){
+    struct vcc_record r;
+
+    r.stamp = t;
+    r.mv = vcc_mv;
+    r.tier = vcc_tier;
+    ring_put(ee_log, &ee_next, &r, sizeof(r), VCC_LOG);
+}
+
+// full rate until the first measurement
+void vcc_init(void){
+    load(0);
+}
+
+/*
+ * adc : bandgap conversion against VCC
+ * t   : s since 2000-01-01
+ * returns 1 when the tier changed
+ */
+uint8_t vcc_update(uint16_t adc, uint32_t t){
+    uint8_t i;
+
+    if (adc == 0)
+        return 0;
+    vcc_mv = (VCC_BANDGAP * 1024) / adc;
+
+    for (i = 0; i < VCC_CUTOFF; i++)
+        if (vcc_mv >= pgm_read_word(&tiers[i].floor) + (i < vcc_tier ? VCC_HYST : 0))
+            break;
+    if (i == vcc_tier)
+        return 0;
+    load(i);
+    record(t);
+    return 1;
+}
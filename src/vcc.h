@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+/* ---------------------------------------------------------------------------
+ * supply voltage from the ADC bandgap channel, and the sampling tier it
+ * allows : fewer readings on a weak battery rather than a dead gauge
+ * ---------------------------------------------------------------------------*/
+
+#define VCC_BANDGAP         1100UL      // mV, nominal, 1.0..1.2 V from part to part, trim per unit
+#define VCC_PERIOD          60          // s between two measurements
+#define VCC_HYST            100         // mV above a tier's floor before moving back up to it
+#define VCC_TIERS           4
+#define VCC_CUTOFF          (VCC_TIERS - 1) // report and sleep
+#define VCC_REPORT          600         // s in power-down between two readings below the cutoff
+#define VCC_LOG             8           // tier changes kept in EEPROM
+
+struct vcc_tier {
+    uint16_t floor;                     // mV, lowest VCC for this tier
+    uint16_t ping;                      // ms between pings
+    uint8_t burst;                      // accepted echoes per filtered reading, <= ECHO_BURST
+    uint16_t refresh;                   // ms between two display updates
+};
+
+struct vcc_record {
+    uint32_t stamp;                     // s since 2000-01-01
+    uint16_t mv;                        // VCC that caused the change
+    uint8_t tier;                       // new tier
+};
+
+extern uint16_t vcc_mv;                 // last measurement, 0 until the first one
+extern uint8_t vcc_tier;                // 0 = full rate .. VCC_CUTOFF
+extern struct vcc_tier vcc;             // settings of vcc_tier
+
+void vcc_init(void);
+uint8_t vcc_update(uint16_t adc, uint32_t t);
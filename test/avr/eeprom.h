@@ -0,0 +1,12 @@
+// host build : EEMEM variables are plain memory, the calls just copy
+#include <stdint.h>
+#include <string.h>
+
+#define EEMEM
+
+static inline uint8_t eeprom_read_byte(const uint8_t *p){ return *p; }
+static inline uint16_t eeprom_read_word(const uint16_t *p){ return *p; }
+static inline void eeprom_read_block(void *d, const void *s, size_t n){ memcpy(d, s, n); }
+static inline void eeprom_update_byte(uint8_t *p, uint8_t v){ *p = v; }
+static inline void eeprom_update_word(uint16_t *p, uint16_t v){ *p = v; }
+static inline void eeprom_update_block(const void *s, void *d, size_t n){ memcpy(d, s, n); }
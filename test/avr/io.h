@@ -0,0 +1 @@
+// host build : nothing of the MCU is used by the modules under test
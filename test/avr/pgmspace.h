@@ -0,0 +1,6 @@
+// host build : flash tables are plain memory
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte(p)        (*(const uint8_t *)(p))
+#define pgm_read_word(p)        (*(const uint16_t *)(p))
@@ -0,0 +1,115 @@
+/*
+ * host test for calib.c, run from src/ :  make -f ../Makefile test
+ *
+ * The traces are what the sensor would report over a tank whose mount and
+ * scale are known: the distance for each reference volume, rounded to the
+ * whole cm srf04 gives. They go through cal_add() (and so fit()) like the
+ * calibration page would, then the fitted mount and scale are compared.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/calib.h"
+
+struct trace {
+    const char *name;
+    int16_t mount;                      // mm, truth
+    uint16_t scale;                     // x CAL_UNITY, truth
+    uint16_t liters[CAL_POINTS];        // references, 0 ends the list
+    int16_t mountTol;                   // mm
+    uint16_t scaleTol;
+};
+
+static const struct trace traces[] = {
+    // one reference only moves the mount, the scale stays 1.0
+    { "single",  1300, CAL_UNITY, { 1500 },                   6, 0 },
+    // all close together : not enough spread, the scale stays too
+    { "close",   1320, CAL_UNITY, { 1500, 1520, 1540, 1560 }, 6, 0 },
+    // mount and scale off together, references spread over the tank
+    { "spread",  1300, 1044,      { 2800, 2000, 900, 300 },   10, 16 },
+    { "short",   1360, 1000,      { 2500, 1500, 600, 250 },   10, 16 },
+};
+
+static int failed;
+
+// the lying cylinder the profile table was made from, in liters
+static long exact(int16_t depth){
+    double r = CAL_RADIUS, h = depth / 10.0;
+
+    return lround(CAL_LENGTH * (r * r * acos((r - h) / r) - (r - h) * sqrt(2 * r * h - h * h)) / 1000);
+}
+
+// what srf04 reads (cm) over a tank holding liters
+static uint16_t reading(const struct trace *t, uint16_t liters){
+    int32_t depth = cal_depth_of(liters);
+
+    return ((int32_t)(t->mount - depth) * CAL_UNITY / t->scale + 5) / 10;
+}
+
+static void check(const char *name, const char *what, long got, long want, long tol){
+    if (labs(got - want) > tol){
+        printf("FAIL %s : %s %ld, expected %ld +- %ld\n", name, what, got, want, tol);
+        failed++;
+    }
+}
+
+int main(void){
+    const struct trace *t;
+    uint16_t lastScale;
+    uint8_t i;
+
+    cal_init();
+    check("init", "mount", cal_mount, CAL_MOUNT, 0);
+    check("init", "scale", cal_scale, CAL_UNITY, 0);
+    check("init", "bottom", cal_bottom, CAL_MOUNT / 10, 0);
+
+    // profile : full and empty, and the inverse lands on the same volume
+    check("profile", "full", cal_volume(2 * CAL_RADIUS * 10), TANK_LITERS, 1);
+    check("profile", "empty", cal_volume(0), 0, 0);
+    for (i = 0; i <= 120; i++)
+        check("profile", "exact", cal_volume(i * 10), exact(i * 10), 5);
+    for (i = 1; i < 30; i++)
+        check("profile", "inverse", cal_volume(cal_depth_of(i * 100)), i * 100, 3);
+
+    for (t = traces; t < traces + sizeof(traces) / sizeof(traces[0]); t++){
+        lastScale = cal_scale;
+        for (i = 0; i < CAL_POINTS && t->liters[i]; i++)
+            cal_add(reading(t, t->liters[i]), t->liters[i]);
+
+        check(t->name, "mount", cal_mount, t->mount, t->mountTol);
+        if (t->scaleTol)
+            check(t->name, "scale", cal_scale, t->scale, t->scaleTol);
+        else
+            check(t->name, "scale kept", cal_scale, lastScale, 0);
+        check(t->name, "bottom", cal_bottom, (int32_t)t->mount * CAL_UNITY / t->scale / 10, 2);
+        printf("%-8s mount %d scale %u bottom %u (%u references)\n",
+               t->name, cal_mount, cal_scale, cal_bottom, cal_points);
+    }
+
+    // the hand-made table in readme.txt (depth cm : liters), a tank a bit
+    // rounder than the model; the fit has to bend it back onto the table
+    {
+        static const uint16_t depth[] = { 790, 630, 460, 275 };
+        static const uint16_t table[] = { 2000, 1500, 1000, 500 };
+        uint16_t d[CAL_POINTS];
+
+        for (i = 0; i < CAL_POINTS; i++){
+            d[i] = (CAL_MOUNT - depth[i] + 5) / 10;
+            cal_add(d[i], table[i]);
+        }
+        for (i = 0; i < CAL_POINTS; i++)
+            check("readme", "liters", cal_volume(cal_depth(d[i])), table[i], 60);
+        printf("%-8s mount %d scale %u bottom %u (%u references)\n",
+               "readme", cal_mount, cal_scale, cal_bottom, cal_points);
+    }
+
+    // a fit outside CAL_SCALE_MIN..MAX is a bad reference, the scale stays
+    lastScale = cal_scale;
+    cal_add(40, 300);
+    check("outlier", "scale kept", cal_scale, lastScale, 0);
+
+    printf(failed ? "%d check(s) failed\n" : "all passed\n", failed);
+    return failed != 0;
+}